@@ -51,6 +51,36 @@
 #include <cmath>
 #include <array>
 
+#if defined (__AVX2__)
+    #define AUDIOFILE_AVX2 1
+    #include <immintrin.h>
+#endif
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define AUDIOFILE_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#if defined (__SSSE3__) || defined (AUDIOFILE_AVX2)
+    #define AUDIOFILE_SSSE3 1
+    #include <tmmintrin.h>
+#endif
+
+#if defined (_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 // disable some warnings on Windows
 #if defined (_MSC_VER)
     __pragma(warning (push))
@@ -79,6 +109,24 @@ enum class AudioFileFormat
     Aiff
 };
 
+//=============================================================
+/** The format of an audio file as read from its header by AudioFile::probe() */
+struct AudioFileInfo
+{
+    AudioFileFormat format {AudioFileFormat::NotLoaded};
+    uint32_t sampleRate {0};
+    int numChannels {0};
+    int bitDepth {0};
+    int64_t numSamplesPerChannel {0};
+
+    /** @Returns the length in seconds based on the number of samples and sample rate */
+    double getLengthInSeconds() const { return sampleRate > 0 ? (double)numSamplesPerChannel / (double)sampleRate : 0.; }
+};
+
+//=============================================================
+template <class T>
+class AudioFileReader;
+
 //=============================================================
 template <class T>
 class AudioFile
@@ -100,6 +148,21 @@ public:
      * @Returns true if the file was successfully loaded
      */
     bool load (const std::string& filePath);
+
+    /** Loads numSamples samples per channel of an audio file, starting at startSample. The file is
+     * memory mapped and only that range of the data (or SSND) chunk is read and decoded, so a short
+     * slice of a long file costs about as much as a file holding just the slice. The range is clamped
+     * to the length of the file, and a negative numSamples loads everything from startSample onwards.
+     * @Returns true if the file was successfully loaded
+     */
+    bool loadRange (const std::string& filePath, int64_t startSample, int64_t numSamples);
+
+    /** Reads only the header of an audio file (the fmt and data chunks of a WAV file, or the
+     * COMM and SSND chunks of an AIFF file) without reading any sample data. The header is parsed
+     * by AudioFileReader, the same parser loadRange() uses, so a file that probes successfully will also load.
+     * @Returns true if the header was read successfully
+     */
+    static bool probe (const std::string& filePath, AudioFileInfo& info);
     
     /** Saves an audio file to a given file path.
      * @Returns true if the file was successfully saved
@@ -110,6 +173,9 @@ public:
     /** Loads an audio file from data in memory */
     bool loadFromMemory (const std::vector<uint8_t>& fileData);
 
+    /** Loads a range of samples from an audio file in memory, in the same way as loadRange() */
+    bool loadRangeFromMemory (const std::vector<uint8_t>& fileData, int64_t startSample, int64_t numSamples);
+
     //=============================================================
     /** Saves an audio file to data in memory */
     bool saveToMemory (std::vector<uint8_t>& fileData, AudioFileFormat format = AudioFileFormat::Wave);
@@ -131,7 +197,7 @@ public:
     int getBitDepth() const;
     
     /** @Returns the number of samples per channel */
-    int getNumSamplesPerChannel() const;
+    int64_t getNumSamplesPerChannel() const;
     
     /** @Returns the length in seconds of the audio file based on the number of samples and sample rate */
     double getLengthInSeconds() const;
@@ -149,12 +215,12 @@ public:
     /** Sets the audio buffer to a given number of channels and number of samples per channel. This will try to preserve
      * the existing audio, adding zeros to any new channels or new samples in a given channel.
      */
-    void setAudioBufferSize (const int numChannels, const int numSamples);
+    void setAudioBufferSize (const int numChannels, const int64_t numSamples);
     
     /** Sets the number of samples per channel in the audio buffer. This will try to preserve
      * the existing audio, adding zeros to new samples in a given channel if the number of samples is increased.
      */
-    void setNumSamplesPerChannel (const int numSamples);
+    void setNumSamplesPerChannel (const int64_t numSamples);
     
     /** Sets the number of channels. New channels will have the correct number of samples and be initialised to zero */
     void setNumChannels (const int numChannels);
@@ -165,6 +231,9 @@ public:
     /** Sets the sample rate for the audio file. If you use the save() function, this sample rate will be used */
     void setSampleRate (const uint32_t newSampleRate);
     
+    /** Sets whether 16-bit output should be TPDF dithered when saving. By default this is false */
+    void setDither (bool shouldDither);
+    
     //=============================================================
     /** Sets whether the library should log error messages to the console. By default this is true */
     void shouldLogErrorsToConsole (bool logErrors);
@@ -191,6 +260,9 @@ private:
         BigEndian
     };
     
+    //=============================================================
+    bool loadFromReader (const AudioFileReader<T>& reader, int64_t startSample, int64_t numSamples);
+
     //=============================================================
     bool decodeWaveFile (const std::vector<uint8_t>& fileData);
     bool decodeAiffFile (const std::vector<uint8_t>& fileData);
@@ -205,13 +277,13 @@ private:
     //=============================================================
     static inline AudioFileFormat determineAudioFileFormat (const std::vector<uint8_t>& fileData);
 
-    static inline int32_t fourBytesToInt (const std::vector<uint8_t>& source, int startIndex, Endianness endianness = Endianness::LittleEndian);
-    static inline int16_t twoBytesToInt (const std::vector<uint8_t>& source, int startIndex, Endianness endianness = Endianness::LittleEndian);
+    static inline int32_t fourBytesToInt (const std::vector<uint8_t>& source, size_t startIndex, Endianness endianness = Endianness::LittleEndian);
+    static inline int16_t twoBytesToInt (const std::vector<uint8_t>& source, size_t startIndex, Endianness endianness = Endianness::LittleEndian);
     static inline int getIndexOfString (const std::vector<uint8_t>& source, std::string s);
-    static inline int getIndexOfChunk (const std::vector<uint8_t>& source, const std::string& chunkHeaderID, int startIndex, Endianness endianness = Endianness::LittleEndian);
+    static inline int64_t getIndexOfChunk (const std::vector<uint8_t>& source, const std::string& chunkHeaderID, int64_t startIndex, Endianness endianness = Endianness::LittleEndian);
 
     //=============================================================
-    static inline uint32_t getAiffSampleRate (const std::vector<uint8_t>& fileData, int sampleRateStartIndex);
+    static inline uint32_t getAiffSampleRate (const std::vector<uint8_t>& fileData, size_t sampleRateStartIndex);
     static inline void addSampleRateToAiffData (std::vector<uint8_t>& fileData, uint32_t sampleRate);
     
     //=============================================================
@@ -229,7 +301,11 @@ private:
     AudioFileFormat audioFileFormat;
     uint32_t sampleRate;
     int bitDepth;
+    bool ditherEnabled {false};
     bool logErrorsToConsole {true};
+
+    //=============================================================
+    template <class U> friend class AudioFileWriter;
 };
 
 //=============================================================
@@ -287,6 +363,83 @@ struct AiffUtilities
     static inline void encodeAiffSampleRate (double sampleRate, uint8_t* bytes);
 };
 
+//=============================================================
+/** The ways a single sample can be stored in the data chunk of a file */
+enum class SampleEncoding
+{
+    UnsignedInt8,
+    SignedInt8,
+    Int16,
+    Int24,
+    Int32,
+    Float32
+};
+
+//=============================================================
+/** Generates triangular (TPDF) dither noise, spanning -1 to +1 LSB, for quantising
+ * to 16-bit. Four independent xorshift generators are kept so that the SIMD encode
+ * kernel can draw four values at a time.
+ */
+struct TpdfDither
+{
+    //=============================================================
+    /** Constructor, seeding the generators from a given value */
+    explicit TpdfDither (uint32_t seed = 0x9E3779B9u);
+
+    /** @Returns the next noise value, in LSBs */
+    float next();
+
+    //=============================================================
+    uint32_t state[4];
+};
+
+//=============================================================
+/** Converts whole blocks of interleaved sample data into separate channel buffers.
+ * The sample encoding is resolved once per block rather than once per sample, and
+ * mono and stereo little-endian data decoded to float uses SSE2/SSSE3/AVX2 kernels
+ * when the compiler targets them, with a scalar loop for everything else.
+ */
+template <class T>
+struct AudioSampleKernels
+{
+    //=============================================================
+    /** Decodes numFrames frames of interleaved data into destination[channel][0] ... destination[channel][numFrames - 1] */
+    static void decode (const uint8_t* source, SampleEncoding encoding, bool bigEndian, int numChannels, int64_t numFrames, T* const* destination);
+
+    /** Encodes numFrames frames from source[channel][0] ... source[channel][numFrames - 1] as interleaved
+     * data, written straight into destination, which must have room for all of the encoded bytes. If a
+     * dither is given, 16-bit output is TPDF dithered and rounded rather than truncated.
+     */
+    static void encode (const T* const* source, int numChannels, int64_t numFrames, SampleEncoding encoding, bool bigEndian, uint8_t* destination, TpdfDither* dither = nullptr);
+
+    /** @Returns the encoding for samples with a given bit depth */
+    static SampleEncoding getEncoding (int bitDepth, bool isFloat, bool isSigned8Bit);
+
+    /** @Returns the number of bytes used by one sample in a given encoding */
+    static int getBytesPerSample (SampleEncoding encoding);
+
+private:
+
+    //=============================================================
+    template <SampleEncoding encoding, bool bigEndian>
+    static T decodeSample (const uint8_t* bytes);
+
+    template <SampleEncoding encoding, bool bigEndian>
+    static void decodeFrames (const uint8_t* source, int numChannels, int64_t startFrame, int64_t numFrames, T* const* destination);
+
+    template <SampleEncoding encoding, bool bigEndian>
+    static void encodeSample (T sample, uint8_t* bytes);
+
+    template <SampleEncoding encoding, bool bigEndian>
+    static void encodeFrames (const T* const* source, int numChannels, int64_t startFrame, int64_t numFrames, uint8_t* destination);
+
+    static void encodeFramesDithered (const T* const* source, int numChannels, int64_t startFrame, int64_t numFrames, bool bigEndian, uint8_t* destination, TpdfDither& dither);
+
+    //=============================================================
+    static int64_t decodeFramesSIMD (const uint8_t* source, SampleEncoding encoding, int numChannels, int64_t numFrames, T* const* destination);
+    static int64_t encodeFramesSIMD (const T* const* source, int numChannels, int64_t numFrames, SampleEncoding encoding, uint8_t* destination, TpdfDither* dither);
+};
+
 //=============================================================
 enum WavAudioFormat
 {
@@ -305,6 +458,248 @@ enum AIFFAudioFormat
     Error
 };
 
+//=============================================================
+/** Writes a .WAV file incrementally. A placeholder header is written when the file
+ * is opened, blocks of samples are appended as they are produced and the chunk sizes
+ * are patched in when the file is closed, so the whole file never has to be in memory.
+ *
+ * The header reserves a JUNK chunk the size of an RF64 ds64 chunk. If the data turns out
+ * to be larger than a 32-bit RIFF size allows, close() turns the file into an RF64 file
+ * (EBU Tech 3306) by replacing the JUNK chunk with a ds64 chunk holding the 64-bit sizes.
+ */
+template <class T>
+class AudioFileWriter
+{
+public:
+
+    //=============================================================
+    /** Constructor */
+    AudioFileWriter() = default;
+
+    /** Destructor. Closes the file if it is still open */
+    ~AudioFileWriter();
+
+    //=============================================================
+    /** Creates the file at the given path and writes a placeholder header.
+     * @Returns true if the file was opened successfully
+     */
+    bool open (const std::string& filePath, uint32_t sampleRate, int numChannels, int bitDepth);
+
+    /** Appends a block of samples, given as one pointer per channel, i.e:
+     *
+     *      channelData[channel][sampleIndex]
+     *
+     * @Returns true if the samples were written successfully
+     */
+    bool write (const T* const* channelData, int numSamples);
+
+    /** Patches the chunk sizes into the header, switching to RF64 if the data is larger
+     * than 4 GB, and closes the file.
+     * @Returns true if the file was finalised successfully
+     */
+    bool close();
+
+    //=============================================================
+    /** @Returns true if the file is open for writing */
+    bool isOpen() const;
+
+    /** @Returns the number of samples per channel written so far */
+    int64_t getNumSamplesWritten() const;
+
+    /** Sets whether 16-bit output should be TPDF dithered. By default this is false */
+    void setDither (bool shouldDither);
+
+    /** Restarts the dither noise from the given seed, so that a block can be encoded
+     * with the same noise again later, e.g. when patching part of an existing file
+     */
+    void setDitherSeed (uint32_t seed);
+
+    //=============================================================
+    /** Sets whether the writer should log error messages to the console. By default this is true */
+    void shouldLogErrorsToConsole (bool logErrors);
+
+private:
+
+    //=============================================================
+    void reportError (const std::string& errorMessage);
+
+    //=============================================================
+    std::ofstream file;
+    std::vector<uint8_t> blockData;
+    uint32_t sampleRate {44100};
+    int numChannels {0};
+    int bitDepth {16};
+    int16_t audioFormat {WavAudioFormat::PCM};
+    int64_t numSamplesWritten {0};
+    int64_t headerSize {0};
+    bool ditherEnabled {false};
+    TpdfDither dither;
+    bool logErrorsToConsole {true};
+};
+
+//=============================================================
+/** A read-only memory mapping of a whole file */
+class MappedFile
+{
+public:
+
+    //=============================================================
+    /** Constructor */
+    MappedFile() = default;
+
+    /** Destructor. Unmaps the file */
+    ~MappedFile();
+
+    MappedFile (const MappedFile&) = delete;
+    MappedFile& operator= (const MappedFile&) = delete;
+
+    /** Move constructor, takes over the other mapping */
+    MappedFile (MappedFile&& other) noexcept;
+
+    /** Move assignment, releases this mapping and takes over the other one */
+    MappedFile& operator= (MappedFile&& other) noexcept;
+
+    //=============================================================
+    /** Maps the file at the given path into memory.
+     * @Returns true if the file was mapped successfully
+     */
+    bool open (const std::string& filePath);
+
+    /** Unmaps the file */
+    void close();
+
+    //=============================================================
+    /** @Returns true if a file is currently mapped */
+    bool isOpen() const;
+
+    /** @Returns a pointer to the first byte of the file */
+    const uint8_t* data() const;
+
+    /** @Returns the size of the file in bytes */
+    size_t size() const;
+
+private:
+
+    //=============================================================
+    const uint8_t* mappedData {nullptr};
+    size_t mappedSize {0};
+
+#if defined (_WIN32)
+    HANDLE fileHandle {INVALID_HANDLE_VALUE};
+    HANDLE mappingHandle {nullptr};
+#endif
+};
+
+//=============================================================
+/** Parses the header of a WAV or AIFF file in place and decodes ranges of its sample data
+ * on demand. Files opened by path are memory mapped rather than read into a buffer, so
+ * opening a file only touches its header and decoding only touches the requested range.
+ */
+template <class T>
+class AudioFileReader
+{
+public:
+
+    //=============================================================
+    /** Constructor */
+    AudioFileReader() = default;
+
+    //=============================================================
+    /** Maps the file at the given path and parses its header.
+     * @Returns true if the file is a valid WAV or AIFF file
+     */
+    bool open (const std::string& filePath);
+
+    /** Parses the header of a file that is already in memory. The data is not copied,
+     * so it must stay valid for as long as the reader is used.
+     * @Returns true if the data is a valid WAV or AIFF file
+     */
+    bool openFromMemory (const uint8_t* data, size_t size);
+
+    /** Releases the file */
+    void close();
+
+    //=============================================================
+    /** @Returns true if a file is open */
+    bool isOpen() const;
+
+    /** @Returns the format of the open file */
+    AudioFileFormat getAudioFileFormat() const;
+
+    /** @Returns the sample rate */
+    uint32_t getSampleRate() const;
+
+    /** @Returns the number of audio channels */
+    int getNumChannels() const;
+
+    /** @Returns the bit depth of each sample */
+    int getBitDepth() const;
+
+    /** @Returns the number of samples per channel */
+    int64_t getNumSamplesPerChannel() const;
+
+    /** @Returns the length in seconds of the audio file based on the number of samples and sample rate */
+    double getLengthInSeconds() const;
+
+    /** @Returns the contents of the iXML chunk, or an empty string if there isn't one */
+    const std::string& getIXMLChunk() const;
+
+    //=============================================================
+    /** @Returns a view of the interleaved sample data, i.e. the contents of the data or SSND chunk */
+    const uint8_t* getSampleData() const;
+
+    /** @Returns the position in bytes of the sample data from the start of the file */
+    size_t getSampleDataOffset() const;
+
+    /** @Returns the size in bytes of the interleaved sample data */
+    size_t getSampleDataSize() const;
+
+    //=============================================================
+    /** Decodes numSamples samples per channel, starting at startSample, into
+     * destination[channel][0] ... destination[channel][numSamples - 1].
+     * @Returns the number of samples per channel that were decoded, which is
+     * smaller than numSamples if the range runs past the end of the file
+     */
+    int64_t read (int64_t startSample, int64_t numSamples, T* const* destination) const;
+
+    //=============================================================
+    /** Sets whether the reader should log error messages to the console. By default this is true */
+    void shouldLogErrorsToConsole (bool logErrors);
+
+private:
+
+    //=============================================================
+    bool parseHeader();
+    bool parseWaveHeader();
+    bool parseAiffHeader();
+
+    //=============================================================
+    int64_t getIndexOfChunk (const char* chunkHeaderID, int64_t startIndex) const;
+    uint32_t readUInt32 (int64_t index) const;
+    uint16_t readUInt16 (int64_t index) const;
+
+    //=============================================================
+    void reportError (const std::string& errorMessage);
+
+    //=============================================================
+    MappedFile mappedFile;
+    std::vector<uint8_t> fallbackData;
+    const uint8_t* fileData {nullptr};
+    size_t fileSize {0};
+
+    AudioFileFormat audioFileFormat {AudioFileFormat::NotLoaded};
+    uint32_t sampleRate {0};
+    int numChannels {0};
+    int bitDepth {0};
+    bool bigEndian {false};
+    SampleEncoding encoding {SampleEncoding::Int16};
+    int64_t numSamplesPerChannel {0};
+    size_t sampleDataIndex {0};
+    size_t sampleDataSize {0};
+    std::string iXMLChunk;
+    bool logErrorsToConsole {true};
+};
+
 //=============================================================
 /* IMPLEMENTATION */
 //=============================================================
@@ -365,10 +760,10 @@ int AudioFile<T>::getBitDepth() const
 
 //=============================================================
 template <class T>
-int AudioFile<T>::getNumSamplesPerChannel() const
+int64_t AudioFile<T>::getNumSamplesPerChannel() const
 {
     if (samples.size() > 0)
-        return (int) samples[0].size();
+        return (int64_t) samples[0].size();
     else
         return 0;
 }
@@ -427,7 +822,7 @@ bool AudioFile<T>::setAudioBuffer (const AudioBuffer& newBuffer)
 
 //=============================================================
 template <class T>
-void AudioFile<T>::setAudioBufferSize (int numChannels, int numSamples)
+void AudioFile<T>::setAudioBufferSize (int numChannels, int64_t numSamples)
 {
     samples.resize (numChannels);
     setNumSamplesPerChannel (numSamples);
@@ -435,13 +830,13 @@ void AudioFile<T>::setAudioBufferSize (int numChannels, int numSamples)
 
 //=============================================================
 template <class T>
-void AudioFile<T>::setNumSamplesPerChannel (int numSamples)
+void AudioFile<T>::setNumSamplesPerChannel (int64_t numSamples)
 {
-    int originalSize = getNumSamplesPerChannel();
+    int64_t originalSize = getNumSamplesPerChannel();
     
     for (int i = 0; i < getNumChannels();i++)
     {
-        samples[i].resize (numSamples);
+        samples[i].resize ((size_t)numSamples);
         
         // set any new samples to zero
         if (numSamples > originalSize)
@@ -454,7 +849,7 @@ template <class T>
 void AudioFile<T>::setNumChannels (int numChannels)
 {
     int originalNumChannels = getNumChannels();
-    int originalNumSamplesPerChannel = getNumSamplesPerChannel();
+    int64_t originalNumSamplesPerChannel = getNumSamplesPerChannel();
     
     samples.resize (numChannels);
     
@@ -464,7 +859,7 @@ void AudioFile<T>::setNumChannels (int numChannels)
     {
         for (int i = originalNumChannels; i < numChannels; i++)
         {
-            samples[i].resize (originalNumSamplesPerChannel);
+            samples[i].resize ((size_t)originalNumSamplesPerChannel);
             std::fill (samples[i].begin(), samples[i].end(), (T)0.);
         }
     }
@@ -484,6 +879,13 @@ void AudioFile<T>::setSampleRate (uint32_t newSampleRate)
     sampleRate = newSampleRate;
 }
 
+//=============================================================
+template <class T>
+void AudioFile<T>::setDither (bool shouldDither)
+{
+    ditherEnabled = shouldDither;
+}
+
 //=============================================================
 template <class T>
 void AudioFile<T>::shouldLogErrorsToConsole (bool logErrors)
@@ -495,46 +897,84 @@ void AudioFile<T>::shouldLogErrorsToConsole (bool logErrors)
 template <class T>
 bool AudioFile<T>::load (const std::string& filePath)
 {
-    std::ifstream file (filePath, std::ios::binary);
-    
-    // check the file exists
-    if (! file.good())
-    {
-        reportError ("ERROR: File doesn't exist or otherwise can't load file\n"  + filePath);
-        return false;
-    }
-    
-    std::vector<uint8_t> fileData;
+    return loadRange (filePath, 0, -1);
+}
 
-	file.unsetf (std::ios::skipws);
+//=============================================================
+template <class T>
+bool AudioFile<T>::loadRange (const std::string& filePath, int64_t startSample, int64_t numSamples)
+{
+    // the file is memory mapped and decoded in place, rather than first being copied into a buffer
+    AudioFileReader<T> reader;
+    reader.shouldLogErrorsToConsole (logErrorsToConsole);
 
-	file.seekg (0, std::ios::end);
-	size_t length = file.tellg();
-	file.seekg (0, std::ios::beg);
+    if (! reader.open (filePath))
+        return false;
 
-	// allocate
-	fileData.resize (length);
+    return loadFromReader (reader, startSample, numSamples);
+}
 
-	file.read(reinterpret_cast<char*> (fileData.data()), length);
-	file.close();
+//=============================================================
+template <class T>
+bool AudioFile<T>::loadRangeFromMemory (const std::vector<uint8_t>& fileData, int64_t startSample, int64_t numSamples)
+{
+    AudioFileReader<T> reader;
+    reader.shouldLogErrorsToConsole (logErrorsToConsole);
 
-	if (file.gcount() != length)
-	{
-		reportError ("ERROR: Couldn't read entire file\n" + filePath);
-		return false;
-	}
-    
-    // Handle very small files that will break our attempt to read the
-    // first header info from them
-    if (fileData.size() < 12)
-    {
-        reportError ("ERROR: File is not a valid audio file\n" + filePath);
+    if (! reader.openFromMemory (fileData.data(), fileData.size()))
         return false;
-    }
-    else
+
+    return loadFromReader (reader, startSample, numSamples);
+}
+
+//=============================================================
+template <class T>
+bool AudioFile<T>::loadFromReader (const AudioFileReader<T>& reader, int64_t startSample, int64_t numSamples)
+{
+    audioFileFormat = reader.getAudioFileFormat();
+    sampleRate = reader.getSampleRate();
+    bitDepth = reader.getBitDepth();
+
+    const int64_t totalSamples = reader.getNumSamplesPerChannel();
+    startSample = std::min (std::max (startSample, (int64_t)0), totalSamples);
+
+    if (numSamples < 0 || numSamples > totalSamples - startSample)
+        numSamples = totalSamples - startSample;
+
+    clearAudioBuffer();
+    samples.resize (reader.getNumChannels());
+
+    std::vector<T*> channelPointers;
+
+    for (auto& channel : samples)
     {
-        return loadFromMemory (fileData);
+        channel.resize ((size_t)numSamples);
+        channelPointers.push_back (channel.data());
     }
+
+    reader.read (startSample, numSamples, channelPointers.data());
+    iXMLChunk = reader.getIXMLChunk();
+
+    return true;
+}
+
+//=============================================================
+template <class T>
+bool AudioFile<T>::probe (const std::string& filePath, AudioFileInfo& info)
+{
+    // the reader maps the file and parses only its header, so no sample data is touched
+    AudioFileReader<T> reader;
+    reader.shouldLogErrorsToConsole (false);
+
+    if (! reader.open (filePath))
+        return false;
+
+    info.format = reader.getAudioFileFormat();
+    info.sampleRate = reader.getSampleRate();
+    info.numChannels = reader.getNumChannels();
+    info.bitDepth = reader.getBitDepth();
+    info.numSamplesPerChannel = reader.getNumSamplesPerChannel();
+    return true;
 }
 
 //=============================================================
@@ -571,13 +1011,13 @@ bool AudioFile<T>::decodeWaveFile (const std::vector<uint8_t>& fileData)
     
     // -----------------------------------------------------------
     // try and find the start points of key chunks
-    int indexOfDataChunk = getIndexOfChunk (fileData, "data", 12);
-    int indexOfFormatChunk = getIndexOfChunk (fileData, "fmt ", 12);
-    int indexOfXMLChunk = getIndexOfChunk (fileData, "iXML", 12);
+    int64_t indexOfDataChunk = getIndexOfChunk (fileData, "data", 12);
+    int64_t indexOfFormatChunk = getIndexOfChunk (fileData, "fmt ", 12);
+    int64_t indexOfXMLChunk = getIndexOfChunk (fileData, "iXML", 12);
     
     // if we can't find the data or format chunks, or the IDs/formats don't seem to be as expected
     // then it is unlikely we'll able to read this file, so abort
-    if (indexOfDataChunk == -1 || indexOfFormatChunk == -1 || headerChunkID != "RIFF" || format != "WAVE")
+    if (indexOfDataChunk == -1 || indexOfFormatChunk == -1 || (headerChunkID != "RIFF" && headerChunkID != "RF64") || format != "WAVE")
     {
         reportError ("ERROR: this doesn't seem to be a valid .WAV file");
         return false;
@@ -585,7 +1025,7 @@ bool AudioFile<T>::decodeWaveFile (const std::vector<uint8_t>& fileData)
     
     // -----------------------------------------------------------
     // FORMAT CHUNK
-    int f = indexOfFormatChunk;
+    size_t f = (size_t)indexOfFormatChunk;
     std::string formatChunkID (fileData.begin() + f, fileData.begin() + f + 4);
     //int32_t formatChunkSize = fourBytesToInt (fileData, f + 4);
     uint16_t audioFormat = twoBytesToInt (fileData, f + 8);
@@ -638,81 +1078,54 @@ bool AudioFile<T>::decodeWaveFile (const std::vector<uint8_t>& fileData)
     
     // -----------------------------------------------------------
     // DATA CHUNK
-    int d = indexOfDataChunk;
+    size_t d = (size_t)indexOfDataChunk;
     std::string dataChunkID (fileData.begin() + d, fileData.begin() + d + 4);
-    int32_t dataChunkSize = fourBytesToInt (fileData, d + 4);
+    uint64_t dataChunkSize = (uint32_t) fourBytesToInt (fileData, d + 4);
+
+    // an RF64 file keeps its 64-bit data size in the ds64 chunk
+    if (headerChunkID == "RF64")
+    {
+        int64_t ds64 = getIndexOfChunk (fileData, "ds64", 12);
+
+        if (ds64 == -1)
+        {
+            reportError ("ERROR: this RF64 file has no ds64 chunk");
+            return false;
+        }
+
+        dataChunkSize = (uint64_t) (uint32_t) fourBytesToInt (fileData, (size_t)ds64 + 16) | ((uint64_t) (uint32_t) fourBytesToInt (fileData, (size_t)ds64 + 20) << 32);
+    }
     
-    int numSamples = dataChunkSize / (numChannels * bitDepth / 8);
-    int samplesStartIndex = indexOfDataChunk + 8;
+    int64_t numSamples = (int64_t) (dataChunkSize / numBytesPerBlock);
+    size_t samplesStartIndex = d + 8;
+    
+    if (samplesStartIndex + (size_t)numSamples * numBytesPerBlock > fileData.size())
+    {
+        reportError ("ERROR: read file error as the metadata indicates more samples than there are in the file data");
+        return false;
+    }
     
     clearAudioBuffer();
     samples.resize (numChannels);
     
-    for (int i = 0; i < numSamples; i++)
+    std::vector<T*> channelPointers;
+    
+    for (auto& channel : samples)
     {
-        for (int channel = 0; channel < numChannels; channel++)
-        {
-            int sampleIndex = samplesStartIndex + (numBytesPerBlock * i) + channel * numBytesPerSample;
-            
-            if ((sampleIndex + (bitDepth / 8) - 1) >= fileData.size())
-            {
-                reportError ("ERROR: read file error as the metadata indicates more samples than there are in the file data");
-                return false;
-            }
-            
-            if (bitDepth == 8)
-            {
-                T sample = AudioSampleConverter<T>::unsignedByteToSample (fileData[sampleIndex]);
-                samples[channel].push_back (sample);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = twoBytesToInt (fileData, sampleIndex);
-                T sample = AudioSampleConverter<T>::sixteenBitIntToSample (sampleAsInt);
-                samples[channel].push_back (sample);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsInt = 0;
-                sampleAsInt = (fileData[sampleIndex + 2] << 16) | (fileData[sampleIndex + 1] << 8) | fileData[sampleIndex];
-                
-                if (sampleAsInt & 0x800000) //  if the 24th bit is set, this is a negative number in 24-bit world
-                    sampleAsInt = sampleAsInt | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
-
-                T sample = AudioSampleConverter<T>::twentyFourBitIntToSample (sampleAsInt);
-                samples[channel].push_back (sample);
-            }
-            else if (bitDepth == 32)
-            {
-                int32_t sampleAsInt = fourBytesToInt (fileData, sampleIndex);
-                T sample;
-                
-                if (audioFormat == WavAudioFormat::IEEEFloat && std::is_floating_point_v<T>) 
-                {
-                    float f;
-                    memcpy (&f, &sampleAsInt, sizeof(int32_t));
-                    sample = (T)f;
-                }
-                else // assume PCM
-                {
-                    sample = AudioSampleConverter<T>::thirtyTwoBitIntToSample (sampleAsInt);
-                }
-                
-                samples[channel].push_back (sample);
-            }
-            else
-            {
-                assert (false);
-            }
-        }
+        channel.resize ((size_t)numSamples);
+        channelPointers.push_back (channel.data());
     }
+    
+    bool isFloat = audioFormat == WavAudioFormat::IEEEFloat && std::is_floating_point_v<T>;
+    SampleEncoding encoding = AudioSampleKernels<T>::getEncoding (bitDepth, isFloat, false);
+    AudioSampleKernels<T>::decode (fileData.data() + samplesStartIndex, encoding, false, numChannels, numSamples, channelPointers.data());
 
     // -----------------------------------------------------------
     // iXML CHUNK
     if (indexOfXMLChunk != -1)
     {
-        int32_t chunkSize = fourBytesToInt (fileData, indexOfXMLChunk + 4);
-        iXMLChunk = std::string ((const char*) &fileData[indexOfXMLChunk + 8], chunkSize);
+        uint32_t chunkSize = (uint32_t) fourBytesToInt (fileData, (size_t)indexOfXMLChunk + 4);
+        iXMLChunk = std::string ((const char*) &fileData[(size_t)indexOfXMLChunk + 8], chunkSize);
     }
 
     return true;
@@ -732,9 +1145,9 @@ bool AudioFile<T>::decodeAiffFile (const std::vector<uint8_t>& fileData)
     
     // -----------------------------------------------------------
     // try and find the start points of key chunks
-    int indexOfCommChunk = getIndexOfChunk (fileData, "COMM", 12, Endianness::BigEndian);
-    int indexOfSoundDataChunk = getIndexOfChunk (fileData, "SSND", 12, Endianness::BigEndian);
-    int indexOfXMLChunk = getIndexOfChunk (fileData, "iXML", 12, Endianness::BigEndian);
+    int64_t indexOfCommChunk = getIndexOfChunk (fileData, "COMM", 12, Endianness::BigEndian);
+    int64_t indexOfSoundDataChunk = getIndexOfChunk (fileData, "SSND", 12, Endianness::BigEndian);
+    int64_t indexOfXMLChunk = getIndexOfChunk (fileData, "iXML", 12, Endianness::BigEndian);
     
     // if we can't find the data or format chunks, or the IDs/formats don't seem to be as expected
     // then it is unlikely we'll able to read this file, so abort
@@ -746,11 +1159,11 @@ bool AudioFile<T>::decodeAiffFile (const std::vector<uint8_t>& fileData)
 
     // -----------------------------------------------------------
     // COMM CHUNK
-    int p = indexOfCommChunk;
+    size_t p = (size_t)indexOfCommChunk;
     std::string commChunkID (fileData.begin() + p, fileData.begin() + p + 4);
     //int32_t commChunkSize = fourBytesToInt (fileData, p + 4, Endianness::BigEndian);
     int16_t numChannels = twoBytesToInt (fileData, p + 8, Endianness::BigEndian);
-    int32_t numSamplesPerChannel = fourBytesToInt (fileData, p + 10, Endianness::BigEndian);
+    int64_t numSamplesPerChannel = (uint32_t) fourBytesToInt (fileData, p + 10, Endianness::BigEndian);
     bitDepth = (int) twoBytesToInt (fileData, p + 14, Endianness::BigEndian);
     sampleRate = getAiffSampleRate (fileData, p + 16);
     
@@ -788,7 +1201,7 @@ bool AudioFile<T>::decodeAiffFile (const std::vector<uint8_t>& fileData)
     
     // -----------------------------------------------------------
     // SSND CHUNK
-    int s = indexOfSoundDataChunk;
+    size_t s = (size_t)indexOfSoundDataChunk;
     std::string soundDataChunkID (fileData.begin() + s, fileData.begin() + s + 4);
     int32_t soundDataChunkSize = fourBytesToInt (fileData, s + 4, Endianness::BigEndian);
     int32_t offset = fourBytesToInt (fileData, s + 8, Endianness::BigEndian);
@@ -796,11 +1209,12 @@ bool AudioFile<T>::decodeAiffFile (const std::vector<uint8_t>& fileData)
     
     int numBytesPerSample = bitDepth / 8;
     int numBytesPerFrame = numBytesPerSample * numChannels;
-    int totalNumAudioSampleBytes = numSamplesPerChannel * numBytesPerFrame;
-    int samplesStartIndex = s + 16 + (int)offset;
+    int64_t totalNumAudioSampleBytes = numSamplesPerChannel * numBytesPerFrame;
+    size_t samplesStartIndex = s + 16 + (uint32_t)offset;
         
     // sanity check the data
-    if ((soundDataChunkSize - 8) != totalNumAudioSampleBytes || totalNumAudioSampleBytes > static_cast<long>(fileData.size() - samplesStartIndex))
+    if ((int64_t) (uint32_t) soundDataChunkSize - 8 != totalNumAudioSampleBytes || samplesStartIndex > fileData.size()
+        || totalNumAudioSampleBytes > static_cast<int64_t>(fileData.size() - samplesStartIndex))
     {
         reportError ("ERROR: the metadatafor this file doesn't seem right");
         return false;
@@ -809,65 +1223,23 @@ bool AudioFile<T>::decodeAiffFile (const std::vector<uint8_t>& fileData)
     clearAudioBuffer();
     samples.resize (numChannels);
     
-    for (int i = 0; i < numSamplesPerChannel; i++)
+    std::vector<T*> channelPointers;
+    
+    for (auto& channel : samples)
     {
-        for (int channel = 0; channel < numChannels; channel++)
-        {
-            int sampleIndex = samplesStartIndex + (numBytesPerFrame * i) + channel * numBytesPerSample;
-            
-            if ((sampleIndex + (bitDepth / 8) - 1) >= fileData.size())
-            {
-                reportError ("ERROR: read file error as the metadata indicates more samples than there are in the file data");
-                return false;
-            }
-            
-            if (bitDepth == 8)
-            {
-                T sample = AudioSampleConverter<T>::signedByteToSample (static_cast<int8_t> (fileData[sampleIndex]));
-                samples[channel].push_back (sample);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = twoBytesToInt (fileData, sampleIndex, Endianness::BigEndian);
-                T sample = AudioSampleConverter<T>::sixteenBitIntToSample (sampleAsInt);
-                samples[channel].push_back (sample);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsInt = 0;
-                sampleAsInt = (fileData[sampleIndex] << 16) | (fileData[sampleIndex + 1] << 8) | fileData[sampleIndex + 2];
-                
-                if (sampleAsInt & 0x800000) //  if the 24th bit is set, this is a negative number in 24-bit world
-                    sampleAsInt = sampleAsInt | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
-
-                T sample = AudioSampleConverter<T>::twentyFourBitIntToSample (sampleAsInt);
-                samples[channel].push_back (sample);
-            }
-            else if (bitDepth == 32)
-            {
-                int32_t sampleAsInt = fourBytesToInt (fileData, sampleIndex, Endianness::BigEndian);
-                T sample;
-                
-                if (audioFormat == AIFFAudioFormat::Compressed)
-                    sample = (T)reinterpret_cast<float&> (sampleAsInt);
-                else // assume PCM
-                    sample = AudioSampleConverter<T>::thirtyTwoBitIntToSample (sampleAsInt);
-                
-                samples[channel].push_back (sample);
-            }
-            else
-            {
-                assert (false);
-            }
-        }
+        channel.resize ((size_t)numSamplesPerChannel);
+        channelPointers.push_back (channel.data());
     }
+    
+    SampleEncoding encoding = AudioSampleKernels<T>::getEncoding (bitDepth, audioFormat == AIFFAudioFormat::Compressed, true);
+    AudioSampleKernels<T>::decode (fileData.data() + samplesStartIndex, encoding, true, numChannels, numSamplesPerChannel, channelPointers.data());
 
     // -----------------------------------------------------------
     // iXML CHUNK
     if (indexOfXMLChunk != -1)
     {
-        int32_t chunkSize = fourBytesToInt (fileData, indexOfXMLChunk + 4);
-        iXMLChunk = std::string ((const char*) &fileData[indexOfXMLChunk + 8], chunkSize);
+        uint32_t chunkSize = (uint32_t) fourBytesToInt (fileData, (size_t)indexOfXMLChunk + 4);
+        iXMLChunk = std::string ((const char*) &fileData[(size_t)indexOfXMLChunk + 8], chunkSize);
     }
     
     return true;
@@ -875,7 +1247,7 @@ bool AudioFile<T>::decodeAiffFile (const std::vector<uint8_t>& fileData)
 
 //=============================================================
 template <class T>
-uint32_t AudioFile<T>::getAiffSampleRate (const std::vector<uint8_t>& fileData, int sampleRateStartIndex)
+uint32_t AudioFile<T>::getAiffSampleRate (const std::vector<uint8_t>& fileData, size_t sampleRateStartIndex)
 {
     double sampleRate = AiffUtilities::decodeAiffSampleRate (&fileData[sampleRateStartIndex]);
     return static_cast<uint32_t> (sampleRate);
@@ -918,7 +1290,14 @@ bool AudioFile<T>::saveToMemory (std::vector<uint8_t>& fileData, AudioFileFormat
 template <class T>
 bool AudioFile<T>::encodeWaveFile (std::vector<uint8_t>& fileData)
 {    
-    int32_t dataChunkSize = getNumSamplesPerChannel() * (getNumChannels() * bitDepth / 8);
+    // a RIFF file built in memory can't describe more than 2 GB of audio - use AudioFileWriter for longer files
+    if (getNumSamplesPerChannel() * (getNumChannels() * bitDepth / 8) > INT32_MAX - 1024)
+    {
+        reportError ("ERROR: too many samples to save as a WAV file in memory, use AudioFileWriter instead");
+        return false;
+    }
+    
+    int32_t dataChunkSize = static_cast<int32_t> (getNumSamplesPerChannel() * (getNumChannels() * bitDepth / 8));
     int16_t audioFormat = bitDepth == 32 && std::is_floating_point_v<T> ? WavAudioFormat::IEEEFloat : WavAudioFormat::PCM;
     int32_t formatChunkSize = audioFormat == WavAudioFormat::PCM ? 16 : 18;
     int32_t iXMLChunkSize = static_cast<int32_t> (iXMLChunk.size());
@@ -963,65 +1342,24 @@ bool AudioFile<T>::encodeWaveFile (std::vector<uint8_t>& fileData)
     addStringToFileData (fileData, "data");
     addInt32ToFileData (fileData, dataChunkSize);
     
-    for (int i = 0; i < getNumSamplesPerChannel(); i++)
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
     {
-        for (int channel = 0; channel < getNumChannels(); channel++)
-        {
-            if (bitDepth == 8)
-            {
-                uint8_t byte = AudioSampleConverter<T>::sampleToUnsignedByte (samples[channel][i]);
-                fileData.push_back (byte);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = AudioSampleConverter<T>::sampleToSixteenBitInt (samples[channel][i]);
-                addInt16ToFileData (fileData, sampleAsInt);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsIntAgain = AudioSampleConverter<T>::sampleToTwentyFourBitInt (samples[channel][i]);
-                
-                uint8_t bytes[3];
-                bytes[2] = (uint8_t) (sampleAsIntAgain >> 16) & 0xFF;
-                bytes[1] = (uint8_t) (sampleAsIntAgain >>  8) & 0xFF;
-                bytes[0] = (uint8_t) sampleAsIntAgain & 0xFF;
-                
-                fileData.push_back (bytes[0]);
-                fileData.push_back (bytes[1]);
-                fileData.push_back (bytes[2]);
-            }
-            else if (bitDepth == 32)
-            {
-                int32_t sampleAsInt;
-                
-                if (audioFormat == WavAudioFormat::IEEEFloat)
-                {
-                    if constexpr (std::is_same_v<T, float>)
-                    {
-                        sampleAsInt = (int32_t) reinterpret_cast<int32_t&> (samples[channel][i]);
-                    }
-                    else if constexpr (std::is_same_v<T, double>)
-                    {
-                        auto sampleAsFloat = (float) samples[channel][i];
-                        float& referenceToSample = sampleAsFloat;
-                        sampleAsInt = (int32_t) reinterpret_cast<int32_t&> (referenceToSample);
-                    }
-                }
-                else // assume PCM
-                {
-                    sampleAsInt = AudioSampleConverter<T>::sampleToThirtyTwoBitInt (samples[channel][i]);
-                }
-                
-                addInt32ToFileData (fileData, sampleAsInt, Endianness::LittleEndian);
-            }
-            else
-            {
-                assert (false && "Trying to write a file with unsupported bit depth");
-                return false;
-            }
-        }
+        assert (false && "Trying to write a file with unsupported bit depth");
+        return false;
     }
     
+    std::vector<const T*> channelPointers;
+    
+    for (auto& channel : samples)
+        channelPointers.push_back (channel.data());
+    
+    TpdfDither dither;
+    size_t samplesStartIndex = fileData.size();
+    fileData.resize (samplesStartIndex + (size_t)dataChunkSize);
+    
+    SampleEncoding encoding = AudioSampleKernels<T>::getEncoding (bitDepth, audioFormat == WavAudioFormat::IEEEFloat, false);
+    AudioSampleKernels<T>::encode (channelPointers.data(), getNumChannels(), getNumSamplesPerChannel(), encoding, false, fileData.data() + samplesStartIndex, ditherEnabled ? &dither : nullptr);
+    
     // -----------------------------------------------------------
     // iXML CHUNK
     if (iXMLChunkSize > 0) 
@@ -1047,7 +1385,14 @@ bool AudioFile<T>::encodeAiffFile (std::vector<uint8_t>& fileData)
 {    
     int32_t numBytesPerSample = bitDepth / 8;
     int32_t numBytesPerFrame = numBytesPerSample * getNumChannels();
-    int32_t totalNumAudioSampleBytes = getNumSamplesPerChannel() * numBytesPerFrame;
+    
+    if (getNumSamplesPerChannel() * numBytesPerFrame > INT32_MAX - 1024)
+    {
+        reportError ("ERROR: too many samples to save as an AIFF file");
+        return false;
+    }
+    
+    int32_t totalNumAudioSampleBytes = static_cast<int32_t> (getNumSamplesPerChannel() * numBytesPerFrame);
     int32_t soundDataChunkSize = totalNumAudioSampleBytes + 8;
     int32_t iXMLChunkSize = static_cast<int32_t> (iXMLChunk.size());
     
@@ -1072,7 +1417,7 @@ bool AudioFile<T>::encodeAiffFile (std::vector<uint8_t>& fileData)
     addStringToFileData (fileData, "COMM");
     addInt32ToFileData (fileData, 18, Endianness::BigEndian); // commChunkSize
     addInt16ToFileData (fileData, getNumChannels(), Endianness::BigEndian); // num channels
-    addInt32ToFileData (fileData, getNumSamplesPerChannel(), Endianness::BigEndian); // num samples per channel
+    addInt32ToFileData (fileData, static_cast<int32_t> (getNumSamplesPerChannel()), Endianness::BigEndian); // num samples per channel
     addInt16ToFileData (fileData, bitDepth, Endianness::BigEndian); // bit depth
     addSampleRateToAiffData (fileData, sampleRate);
     
@@ -1083,46 +1428,24 @@ bool AudioFile<T>::encodeAiffFile (std::vector<uint8_t>& fileData)
     addInt32ToFileData (fileData, 0, Endianness::BigEndian); // offset
     addInt32ToFileData (fileData, 0, Endianness::BigEndian); // block size
     
-    for (int i = 0; i < getNumSamplesPerChannel(); i++)
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
     {
-        for (int channel = 0; channel < getNumChannels(); channel++)
-        {
-            if (bitDepth == 8)
-            {
-                uint8_t byte = static_cast<uint8_t> (AudioSampleConverter<T>::sampleToSignedByte (samples[channel][i]));
-                fileData.push_back (byte);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = AudioSampleConverter<T>::sampleToSixteenBitInt (samples[channel][i]);
-                addInt16ToFileData (fileData, sampleAsInt, Endianness::BigEndian);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsIntAgain = AudioSampleConverter<T>::sampleToTwentyFourBitInt (samples[channel][i]);
-                
-                uint8_t bytes[3];
-                bytes[0] = (uint8_t) (sampleAsIntAgain >> 16) & 0xFF;
-                bytes[1] = (uint8_t) (sampleAsIntAgain >>  8) & 0xFF;
-                bytes[2] = (uint8_t) sampleAsIntAgain & 0xFF;
-                
-                fileData.push_back (bytes[0]);
-                fileData.push_back (bytes[1]);
-                fileData.push_back (bytes[2]);
-            }
-            else if (bitDepth == 32)
-            {
-                // write samples as signed integers (no implementation yet for floating point, but looking at WAV implementation should help)
-                int32_t sampleAsInt = AudioSampleConverter<T>::sampleToThirtyTwoBitInt (samples[channel][i]);
-                addInt32ToFileData (fileData, sampleAsInt, Endianness::BigEndian);
-            }
-            else
-            {
-                assert (false && "Trying to write a file with unsupported bit depth");
-                return false;
-            }
-        }
+        assert (false && "Trying to write a file with unsupported bit depth");
+        return false;
     }
+    
+    std::vector<const T*> channelPointers;
+    
+    for (auto& channel : samples)
+        channelPointers.push_back (channel.data());
+    
+    // write 32-bit samples as signed integers (no implementation yet for floating point, but looking at WAV implementation should help)
+    TpdfDither dither;
+    size_t samplesStartIndex = fileData.size();
+    fileData.resize (samplesStartIndex + (size_t)totalNumAudioSampleBytes);
+    
+    SampleEncoding encoding = AudioSampleKernels<T>::getEncoding (bitDepth, false, true);
+    AudioSampleKernels<T>::encode (channelPointers.data(), getNumChannels(), getNumSamplesPerChannel(), encoding, true, fileData.data() + samplesStartIndex, ditherEnabled ? &dither : nullptr);
 
     // -----------------------------------------------------------
     // iXML CHUNK
@@ -1234,7 +1557,7 @@ AudioFileFormat AudioFile<T>::determineAudioFileFormat (const std::vector<uint8_
     
     std::string header (fileData.begin(), fileData.begin() + 4);
     
-    if (header == "RIFF")
+    if (header == "RIFF" || header == "RF64")
         return AudioFileFormat::Wave;
     else if (header == "FORM")
         return AudioFileFormat::Aiff;
@@ -1244,7 +1567,7 @@ AudioFileFormat AudioFile<T>::determineAudioFileFormat (const std::vector<uint8_
 
 //=============================================================
 template <class T>
-int32_t AudioFile<T>::fourBytesToInt (const std::vector<uint8_t>& source, int startIndex, Endianness endianness)
+int32_t AudioFile<T>::fourBytesToInt (const std::vector<uint8_t>& source, size_t startIndex, Endianness endianness)
 {
     if (source.size() >= (startIndex + 4))
     {
@@ -1266,7 +1589,7 @@ int32_t AudioFile<T>::fourBytesToInt (const std::vector<uint8_t>& source, int st
 
 //=============================================================
 template <class T>
-int16_t AudioFile<T>::twoBytesToInt (const std::vector<uint8_t>& source, int startIndex, Endianness endianness)
+int16_t AudioFile<T>::twoBytesToInt (const std::vector<uint8_t>& source, size_t startIndex, Endianness endianness)
 {
     int16_t result;
     
@@ -1280,7 +1603,7 @@ int16_t AudioFile<T>::twoBytesToInt (const std::vector<uint8_t>& source, int sta
 
 //=============================================================
 template <class T>
-int AudioFile<T>::getIndexOfChunk (const std::vector<uint8_t>& source, const std::string& chunkHeaderID, int startIndex, Endianness endianness)
+int64_t AudioFile<T>::getIndexOfChunk (const std::vector<uint8_t>& source, const std::string& chunkHeaderID, int64_t startIndex, Endianness endianness)
 {
     constexpr int dataLen = 4;
     
@@ -1290,10 +1613,11 @@ int AudioFile<T>::getIndexOfChunk (const std::vector<uint8_t>& source, const std
         return -1;
     }
 
-    int i = startIndex;
-    while (i < source.size() - dataLen)
+    const int64_t size = (int64_t)source.size();
+    int64_t i = startIndex;
+    while (i < size - dataLen)
     {
-        if (memcmp (&source[i], chunkHeaderID.data(), dataLen) == 0)
+        if (memcmp (&source[(size_t)i], chunkHeaderID.data(), dataLen) == 0)
         {
             return i;
         }
@@ -1301,16 +1625,15 @@ int AudioFile<T>::getIndexOfChunk (const std::vector<uint8_t>& source, const std
         i += dataLen;
         
         // If somehow we don't have 4 bytes left to read, then exit with -1
-        if ((i + 4) >= source.size())
+        if ((i + 4) >= size)
             return -1;
         
-        int32_t chunkSize = fourBytesToInt (source, i, endianness);
+        // chunk sizes are unsigned 32-bit, so a chunk may be up to 4 GB
+        int64_t chunkSize = (uint32_t) fourBytesToInt (source, (size_t)i, endianness);
         // Assume chunk size is invalid if it's greater than the number of bytes remaining in source
-        if (chunkSize > (source.size() - i - dataLen) || (chunkSize < 0))
-        {
-            assert (false && "Invalid chunk size");
+        // (an RF64 data chunk has the placeholder size 0xFFFFFFFF, so this is not always a corrupt file)
+        if (chunkSize > (size - i - dataLen))
             return -1;
-        }
         i += (dataLen + chunkSize);
     }
 
@@ -1326,206 +1649,996 @@ void AudioFile<T>::reportError (const std::string& errorMessage)
 }
 
 //=============================================================
-template <typename SignedType>
-typename std::make_unsigned<SignedType>::type convertSignedToUnsigned (SignedType signedValue)
+template <class T>
+AudioFileWriter<T>::~AudioFileWriter()
 {
-    static_assert (std::is_signed<SignedType>::value, "The input value must be signed");
-    
-    typename std::make_unsigned<SignedType>::type unsignedValue = static_cast<typename std::make_unsigned<SignedType>::type> (1) + std::numeric_limits<SignedType>::max();
-    
-    unsignedValue += signedValue;
-    return unsignedValue;
+    if (isOpen())
+        close();
 }
 
-//=============================================================
-enum SampleLimit
-{
-    SignedInt16_Min = -32768,
-    SignedInt16_Max = 32767,
-    UnsignedInt16_Min = 0,
-    UnsignedInt16_Max = 65535,
-    SignedInt24_Min = -8388608,
-    SignedInt24_Max = 8388607,
-    UnsignedInt24_Min = 0,
-    UnsignedInt24_Max = 16777215
-};
-
 //=============================================================
 template <class T>
-T AudioSampleConverter<T>::thirtyTwoBitIntToSample (int32_t sample)
+bool AudioFileWriter<T>::open (const std::string& filePath, uint32_t newSampleRate, int newNumChannels, int newBitDepth)
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        return static_cast<T> (sample) / static_cast<T> (std::numeric_limits<int32_t>::max());
-    }
-    else if (std::numeric_limits<T>::is_integer)
+    if (isOpen())
+        close();
+
+    if (newNumChannels < 1 || newNumChannels > 128)
     {
-        if constexpr (std::is_signed_v<T>)
-			return static_cast<T> (sample);
-        else
-            return static_cast<T> (clamp (static_cast<T> (sample + 2147483648), 0, 4294967295));
+        reportError ("ERROR: can't write a WAV file with " + std::to_string (newNumChannels) + " channels");
+        return false;
     }
-}
 
-//=============================================================
-template <class T>
-int32_t AudioSampleConverter<T>::sampleToThirtyTwoBitInt (T sample)
-{
-    if constexpr (std::is_floating_point<T>::value)
+    if (newBitDepth != 8 && newBitDepth != 16 && newBitDepth != 24 && newBitDepth != 32)
     {
-        // multiplying a float by a the max int32_t is problematic because
-        // of roundng errors which can cause wrong values to come out, so
-        // we use a different implementation here compared to other types
-        if constexpr (std::is_same_v<T, float>)
-        {
-            if (sample >= 1.f)
-                return std::numeric_limits<int32_t>::max();
-            else if (sample <= -1.f)
-                return std::numeric_limits<int32_t>::lowest() + 1; // starting at 1 preserves symmetry
-            else
-                return static_cast<int32_t> (sample * std::numeric_limits<int32_t>::max());
-        }
-        else
-        {
-            return static_cast<int32_t> (clamp (sample, -1., 1.) * std::numeric_limits<int32_t>::max());
-        }
+        reportError ("ERROR: can't write a WAV file with a bit depth that is not 8, 16, 24 or 32 bits");
+        return false;
     }
-    else
+
+    file.open (filePath, std::ios::binary | std::ios::trunc);
+
+    if (! file.is_open())
     {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<int32_t> (clamp (sample, -2147483648LL, 2147483647LL));
-        else
-            return static_cast<int32_t> (clamp (sample, 0, 4294967295) - 2147483648);
+        reportError ("ERROR: couldn't open file for writing\n" + filePath);
+        return false;
     }
+
+    sampleRate = newSampleRate;
+    numChannels = newNumChannels;
+    bitDepth = newBitDepth;
+    audioFormat = bitDepth == 32 && std::is_floating_point_v<T> ? WavAudioFormat::IEEEFloat : WavAudioFormat::PCM;
+    numSamplesWritten = 0;
+
+    int32_t formatChunkSize = audioFormat == WavAudioFormat::PCM ? 16 : 18;
+
+    // -----------------------------------------------------------
+    // HEADER AND FORMAT CHUNKS (the RIFF and data chunk sizes are patched in by close())
+    std::vector<uint8_t> header;
+    AudioFile<T>::addStringToFileData (header, "RIFF");
+    AudioFile<T>::addInt32ToFileData (header, 0);
+    AudioFile<T>::addStringToFileData (header, "WAVE");
+
+    // space for a ds64 chunk, in case the file needs to become RF64
+    AudioFile<T>::addStringToFileData (header, "JUNK");
+    AudioFile<T>::addInt32ToFileData (header, 28);
+    header.insert (header.end(), 28, 0);
+
+    AudioFile<T>::addStringToFileData (header, "fmt ");
+    AudioFile<T>::addInt32ToFileData (header, formatChunkSize);
+    AudioFile<T>::addInt16ToFileData (header, audioFormat);
+    AudioFile<T>::addInt16ToFileData (header, (int16_t)numChannels);
+    AudioFile<T>::addInt32ToFileData (header, (int32_t)sampleRate);
+    AudioFile<T>::addInt32ToFileData (header, (int32_t) ((numChannels * sampleRate * bitDepth) / 8));
+    AudioFile<T>::addInt16ToFileData (header, (int16_t) (numChannels * (bitDepth / 8)));
+    AudioFile<T>::addInt16ToFileData (header, (int16_t)bitDepth);
+
+    if (audioFormat == WavAudioFormat::IEEEFloat)
+        AudioFile<T>::addInt16ToFileData (header, 0); // extension size
+
+    AudioFile<T>::addStringToFileData (header, "data");
+    AudioFile<T>::addInt32ToFileData (header, 0);
+
+    headerSize = (int64_t)header.size();
+    file.write ((const char*)header.data(), header.size());
+    return file.good();
 }
 
 //=============================================================
 template <class T>
-T AudioSampleConverter<T>::twentyFourBitIntToSample (int32_t sample)
+bool AudioFileWriter<T>::write (const T* const* channelData, int numSamples)
 {
-    if constexpr (std::is_floating_point<T>::value)
+    if (! isOpen())
     {
-        return static_cast<T> (sample) / static_cast<T> (8388607.);
+        reportError ("ERROR: trying to write to a file that isn't open");
+        return false;
     }
-    else if (std::numeric_limits<T>::is_integer)
+
+    blockData.resize ((size_t)numSamples * numChannels * (bitDepth / 8));
+
+    SampleEncoding encoding = AudioSampleKernels<T>::getEncoding (bitDepth, audioFormat == WavAudioFormat::IEEEFloat, false);
+    AudioSampleKernels<T>::encode (channelData, numChannels, numSamples, encoding, false, blockData.data(), ditherEnabled ? &dither : nullptr);
+
+    file.write ((const char*)blockData.data(), blockData.size());
+    numSamplesWritten += numSamples;
+
+    if (! file.good())
     {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<T> (clamp (sample, SignedInt24_Min, SignedInt24_Max));
-        else
-            return static_cast<T> (clamp (sample + 8388608, UnsignedInt24_Min, UnsignedInt24_Max));
+        reportError ("ERROR: failed to write audio data to file");
+        return false;
     }
+
+    return true;
 }
 
 //=============================================================
 template <class T>
-int32_t AudioSampleConverter<T>::sampleToTwentyFourBitInt (T sample)
+bool AudioFileWriter<T>::close()
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        sample = clamp (sample, -1., 1.);
-        return static_cast<int32_t> (sample * 8388607.);
+    if (! isOpen())
+        return false;
+
+    int64_t dataChunkSize = numSamplesWritten * numChannels * (bitDepth / 8);
+    int64_t riffSize = headerSize - 8 + dataChunkSize + (dataChunkSize % 2);
+
+    // a pad byte keeps the RIFF chunk word aligned for 8-bit mono files with an odd length
+    if (dataChunkSize % 2 == 1)
+        file.put (0);
+
+    std::vector<uint8_t> size;
+
+    if (riffSize > std::numeric_limits<uint32_t>::max())
+    {
+        // RF64: the 32-bit sizes are set to -1 and the real sizes go in the ds64 chunk
+        AudioFile<T>::addStringToFileData (size, "RF64");
+        AudioFile<T>::addInt32ToFileData (size, -1);
+        file.seekp (0);
+        file.write ((const char*)size.data(), size.size());
+
+        size.clear();
+        AudioFile<T>::addStringToFileData (size, "ds64");
+        AudioFile<T>::addInt32ToFileData (size, 28);
+        AudioFile<T>::addInt32ToFileData (size, (int32_t) (riffSize & 0xFFFFFFFF));
+        AudioFile<T>::addInt32ToFileData (size, (int32_t) (riffSize >> 32));
+        AudioFile<T>::addInt32ToFileData (size, (int32_t) (dataChunkSize & 0xFFFFFFFF));
+        AudioFile<T>::addInt32ToFileData (size, (int32_t) (dataChunkSize >> 32));
+        AudioFile<T>::addInt32ToFileData (size, (int32_t) (numSamplesWritten & 0xFFFFFFFF));
+        AudioFile<T>::addInt32ToFileData (size, (int32_t) (numSamplesWritten >> 32));
+        AudioFile<T>::addInt32ToFileData (size, 0); // table length
+        file.seekp (12);
+        file.write ((const char*)size.data(), size.size());
+
+        size.clear();
+        AudioFile<T>::addInt32ToFileData (size, -1);
+        file.seekp (headerSize - 4);
+        file.write ((const char*)size.data(), size.size());
     }
     else
     {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<int32_t> (clamp (sample, SignedInt24_Min, SignedInt24_Max));
-        else
-            return static_cast<int32_t> (clamp (sample, UnsignedInt24_Min, UnsignedInt24_Max) + SignedInt24_Min);
+        AudioFile<T>::addInt32ToFileData (size, (int32_t)riffSize);
+        file.seekp (4);
+        file.write ((const char*)size.data(), size.size());
+
+        size.clear();
+        AudioFile<T>::addInt32ToFileData (size, (int32_t)dataChunkSize);
+        file.seekp (headerSize - 4);
+        file.write ((const char*)size.data(), size.size());
     }
+
+    bool ok = file.good();
+    file.close();
+
+    if (! ok)
+        reportError ("ERROR: failed to finalise the WAV file header");
+
+    return ok;
 }
 
 //=============================================================
 template <class T>
-T AudioSampleConverter<T>::sixteenBitIntToSample (int16_t sample)
+bool AudioFileWriter<T>::isOpen() const
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        return static_cast<T> (sample) / static_cast<T> (32767.);
-    }
-    else if constexpr (std::numeric_limits<T>::is_integer)
-    {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<T> (sample);
-        else
-            return static_cast<T> (convertSignedToUnsigned<int16_t> (sample));
-    }
+    return file.is_open();
 }
 
 //=============================================================
 template <class T>
-int16_t AudioSampleConverter<T>::sampleToSixteenBitInt (T sample)
+int64_t AudioFileWriter<T>::getNumSamplesWritten() const
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        sample = clamp (sample, -1., 1.);
-        return static_cast<int16_t> (sample * 32767.);
-    }
-    else
-    {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<int16_t> (clamp (sample, SignedInt16_Min, SignedInt16_Max));
-        else
-            return static_cast<int16_t> (clamp (sample, UnsignedInt16_Min, UnsignedInt16_Max) + SignedInt16_Min);
-    }
+    return numSamplesWritten;
 }
 
 //=============================================================
 template <class T>
-uint8_t AudioSampleConverter<T>::sampleToUnsignedByte (T sample)
+void AudioFileWriter<T>::setDither (bool shouldDither)
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        sample = clamp (sample, -1., 1.);
-        sample = (sample + 1.) / 2.;
-        return static_cast<uint8_t> (1 + (sample * 254));
-    }
-    else
-    {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<uint8_t> (clamp (sample, -128, 127) + 128);
-        else
-            return static_cast<uint8_t> (clamp (sample, 0, 255));
-    }
+    ditherEnabled = shouldDither;
 }
 
 //=============================================================
 template <class T>
-int8_t AudioSampleConverter<T>::sampleToSignedByte (T sample)
+void AudioFileWriter<T>::setDitherSeed (uint32_t seed)
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        sample = clamp (sample, -1., 1.);
-        return static_cast<int8_t> (sample * (T)0x7F);
-    }
-    else
-    {
-        if constexpr (std::is_signed_v<T>)
-            return static_cast<int8_t> (clamp (sample, -128, 127));
-        else
-            return static_cast<int8_t> (clamp (sample, 0, 255) - 128);
-    }
+    dither = TpdfDither (seed);
 }
 
 //=============================================================
 template <class T>
-T AudioSampleConverter<T>::unsignedByteToSample (uint8_t sample)
+void AudioFileWriter<T>::shouldLogErrorsToConsole (bool logErrors)
 {
-    if constexpr (std::is_floating_point<T>::value)
-    {
-        return static_cast<T> (sample - 128) / static_cast<T> (127.);
-    }
-    else if (std::numeric_limits<T>::is_integer)
-    {
-        if constexpr (std::is_unsigned_v<T>)
-            return static_cast<T> (sample);
-        else
-            return static_cast<T> (sample - 128);
-    }
+    logErrorsToConsole = logErrors;
 }
 
 //=============================================================
 template <class T>
-T AudioSampleConverter<T>::signedByteToSample (int8_t sample)
+void AudioFileWriter<T>::reportError (const std::string& errorMessage)
+{
+    if (logErrorsToConsole)
+        std::cerr << errorMessage << std::endl;
+}
+
+//=============================================================
+inline MappedFile::~MappedFile()
+{
+    close();
+}
+
+//=============================================================
+inline MappedFile::MappedFile (MappedFile&& other) noexcept
+{
+    *this = std::move (other);
+}
+
+//=============================================================
+inline MappedFile& MappedFile::operator= (MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap (mappedData, other.mappedData);
+        std::swap (mappedSize, other.mappedSize);
+#if defined (_WIN32)
+        std::swap (fileHandle, other.fileHandle);
+        std::swap (mappingHandle, other.mappingHandle);
+#endif
+    }
+
+    return *this;
+}
+
+//=============================================================
+inline bool MappedFile::open (const std::string& filePath)
+{
+    close();
+
+#if defined (_WIN32)
+    fileHandle = CreateFileA (filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+
+    if (! GetFileSizeEx (fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingA (fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (mappingHandle == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    mappedData = static_cast<const uint8_t*> (MapViewOfFile (mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+    if (mappedData == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    mappedSize = static_cast<size_t> (fileSize.QuadPart);
+#else
+    int fd = ::open (filePath.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat fileInfo;
+
+    if (fstat (fd, &fileInfo) != 0 || ! S_ISREG (fileInfo.st_mode) || fileInfo.st_size == 0)
+    {
+        ::close (fd);
+        return false;
+    }
+
+    void* address = mmap (nullptr, static_cast<size_t> (fileInfo.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close (fd); // the mapping keeps its own reference to the file
+
+    if (address == MAP_FAILED)
+        return false;
+
+    mappedData = static_cast<const uint8_t*> (address);
+    mappedSize = static_cast<size_t> (fileInfo.st_size);
+#endif
+
+    return true;
+}
+
+//=============================================================
+inline void MappedFile::close()
+{
+#if defined (_WIN32)
+    if (mappedData != nullptr)
+        UnmapViewOfFile (mappedData);
+
+    if (mappingHandle != nullptr)
+        CloseHandle (mappingHandle);
+
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle (fileHandle);
+
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (mappedData != nullptr)
+        munmap (const_cast<uint8_t*> (mappedData), mappedSize);
+#endif
+
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+//=============================================================
+inline bool MappedFile::isOpen() const
+{
+    return mappedData != nullptr;
+}
+
+//=============================================================
+inline const uint8_t* MappedFile::data() const
+{
+    return mappedData;
+}
+
+//=============================================================
+inline size_t MappedFile::size() const
+{
+    return mappedSize;
+}
+
+//=============================================================
+template <class T>
+bool AudioFileReader<T>::open (const std::string& filePath)
+{
+    close();
+
+    if (mappedFile.open (filePath))
+    {
+        fileData = mappedFile.data();
+        fileSize = mappedFile.size();
+    }
+    else
+    {
+        // files that can't be mapped (pipes, empty files, ...) are read into memory instead
+        std::ifstream file (filePath, std::ios::binary);
+
+        if (! file.good())
+        {
+            reportError ("ERROR: File doesn't exist or otherwise can't load file\n"  + filePath);
+            return false;
+        }
+
+        fallbackData.assign (std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char>());
+        fileData = fallbackData.data();
+        fileSize = fallbackData.size();
+    }
+
+    // Handle very small files that will break our attempt to read the
+    // first header info from them
+    if (fileSize < 12)
+    {
+        reportError ("ERROR: File is not a valid audio file\n" + filePath);
+        close();
+        return false;
+    }
+
+    return parseHeader();
+}
+
+//=============================================================
+template <class T>
+bool AudioFileReader<T>::openFromMemory (const uint8_t* data, size_t size)
+{
+    close();
+
+    fileData = data;
+    fileSize = size;
+
+    if (fileData == nullptr || fileSize < 12)
+    {
+        reportError ("ERROR: File is not a valid audio file");
+        close();
+        return false;
+    }
+
+    return parseHeader();
+}
+
+//=============================================================
+template <class T>
+void AudioFileReader<T>::close()
+{
+    mappedFile.close();
+    fallbackData.clear();
+    fallbackData.shrink_to_fit();
+    fileData = nullptr;
+    fileSize = 0;
+    audioFileFormat = AudioFileFormat::NotLoaded;
+    numSamplesPerChannel = 0;
+    sampleDataIndex = 0;
+    sampleDataSize = 0;
+    iXMLChunk.clear();
+}
+
+//=============================================================
+template <class T>
+bool AudioFileReader<T>::isOpen() const
+{
+    return audioFileFormat == AudioFileFormat::Wave || audioFileFormat == AudioFileFormat::Aiff;
+}
+
+//=============================================================
+template <class T>
+AudioFileFormat AudioFileReader<T>::getAudioFileFormat() const
+{
+    return audioFileFormat;
+}
+
+//=============================================================
+template <class T>
+uint32_t AudioFileReader<T>::getSampleRate() const
+{
+    return sampleRate;
+}
+
+//=============================================================
+template <class T>
+int AudioFileReader<T>::getNumChannels() const
+{
+    return numChannels;
+}
+
+//=============================================================
+template <class T>
+int AudioFileReader<T>::getBitDepth() const
+{
+    return bitDepth;
+}
+
+//=============================================================
+template <class T>
+int64_t AudioFileReader<T>::getNumSamplesPerChannel() const
+{
+    return numSamplesPerChannel;
+}
+
+//=============================================================
+template <class T>
+double AudioFileReader<T>::getLengthInSeconds() const
+{
+    return sampleRate > 0 ? (double)numSamplesPerChannel / (double)sampleRate : 0.;
+}
+
+//=============================================================
+template <class T>
+const std::string& AudioFileReader<T>::getIXMLChunk() const
+{
+    return iXMLChunk;
+}
+
+//=============================================================
+template <class T>
+const uint8_t* AudioFileReader<T>::getSampleData() const
+{
+    return isOpen() ? fileData + sampleDataIndex : nullptr;
+}
+
+//=============================================================
+template <class T>
+size_t AudioFileReader<T>::getSampleDataOffset() const
+{
+    return sampleDataIndex;
+}
+
+//=============================================================
+template <class T>
+size_t AudioFileReader<T>::getSampleDataSize() const
+{
+    return sampleDataSize;
+}
+
+//=============================================================
+template <class T>
+int64_t AudioFileReader<T>::read (int64_t startSample, int64_t numSamples, T* const* destination) const
+{
+    if (! isOpen() || startSample < 0 || numSamples <= 0 || startSample >= numSamplesPerChannel)
+        return 0;
+
+    numSamples = std::min (numSamples, numSamplesPerChannel - startSample);
+
+    const int64_t numBytesPerFrame = (int64_t) (bitDepth / 8) * numChannels;
+    AudioSampleKernels<T>::decode (fileData + sampleDataIndex + startSample * numBytesPerFrame, encoding, bigEndian, numChannels, numSamples, destination);
+
+    return numSamples;
+}
+
+//=============================================================
+template <class T>
+void AudioFileReader<T>::shouldLogErrorsToConsole (bool logErrors)
+{
+    logErrorsToConsole = logErrors;
+}
+
+//=============================================================
+template <class T>
+bool AudioFileReader<T>::parseHeader()
+{
+    bool ok = false;
+
+    if (memcmp (fileData, "RIFF", 4) == 0 || memcmp (fileData, "RF64", 4) == 0)
+    {
+        audioFileFormat = AudioFileFormat::Wave;
+        bigEndian = false;
+        ok = parseWaveHeader();
+    }
+    else if (memcmp (fileData, "FORM", 4) == 0)
+    {
+        audioFileFormat = AudioFileFormat::Aiff;
+        bigEndian = true;
+        ok = parseAiffHeader();
+    }
+    else
+    {
+        reportError ("Audio File Type: Error");
+    }
+
+    if (! ok)
+        close();
+
+    return ok;
+}
+
+//=============================================================
+template <class T>
+bool AudioFileReader<T>::parseWaveHeader()
+{
+    int64_t indexOfDataChunk = getIndexOfChunk ("data", 12);
+    int64_t indexOfFormatChunk = getIndexOfChunk ("fmt ", 12);
+    int64_t indexOfXMLChunk = getIndexOfChunk ("iXML", 12);
+
+    if (indexOfDataChunk == -1 || indexOfFormatChunk == -1 || memcmp (fileData + 8, "WAVE", 4) != 0)
+    {
+        reportError ("ERROR: this doesn't seem to be a valid .WAV file");
+        return false;
+    }
+
+    // -----------------------------------------------------------
+    // FORMAT CHUNK
+    int64_t f = indexOfFormatChunk;
+    uint32_t formatChunkSize = readUInt32 (f + 4);
+    uint16_t audioFormat = readUInt16 (f + 8);
+    uint16_t channels = readUInt16 (f + 10);
+    sampleRate = readUInt32 (f + 12);
+    uint32_t numBytesPerSecond = readUInt32 (f + 16);
+    uint16_t numBytesPerBlock = readUInt16 (f + 20);
+    bitDepth = readUInt16 (f + 22);
+
+    // the real format of an extensible file is the first two bytes of its sub-format GUID
+    if (audioFormat == WavAudioFormat::Extensible && formatChunkSize >= 40)
+        audioFormat = readUInt16 (f + 32);
+
+    if (bitDepth > sizeof (T) * 8)
+    {
+        std::string message = "ERROR: you are trying to read a ";
+        message += std::to_string (bitDepth);
+        message += "-bit file using a ";
+        message += std::to_string (sizeof (T) * 8);
+        message += "-bit sample type";
+        reportError (message);
+        return false;
+    }
+
+    if (audioFormat != WavAudioFormat::PCM && audioFormat != WavAudioFormat::IEEEFloat && audioFormat != WavAudioFormat::Extensible)
+    {
+        reportError ("ERROR: this .WAV file is encoded in a format that this library does not support at present");
+        return false;
+    }
+
+    if (channels < 1 || channels > 128)
+    {
+        reportError ("ERROR: this WAV file seems to be an invalid number of channels (or corrupted?)");
+        return false;
+    }
+
+    if (numBytesPerSecond != static_cast<uint32_t> ((channels * sampleRate * bitDepth) / 8) || numBytesPerBlock != (channels * (bitDepth / 8)))
+    {
+        reportError ("ERROR: the header data in this WAV file seems to be inconsistent");
+        return false;
+    }
+
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
+    {
+        reportError ("ERROR: this file has a bit depth that is not 8, 16, 24 or 32 bits");
+        return false;
+    }
+
+    numChannels = channels;
+    encoding = AudioSampleKernels<T>::getEncoding (bitDepth, audioFormat == WavAudioFormat::IEEEFloat && std::is_floating_point_v<T>, false);
+
+    // -----------------------------------------------------------
+    // DATA CHUNK
+    int64_t d = indexOfDataChunk;
+    sampleDataIndex = (size_t) (d + 8);
+    sampleDataSize = readUInt32 (d + 4);
+
+    // an RF64 file keeps its 64-bit data size in the ds64 chunk
+    if (memcmp (fileData, "RF64", 4) == 0)
+    {
+        int64_t ds64 = getIndexOfChunk ("ds64", 12);
+
+        if (ds64 == -1)
+        {
+            reportError ("ERROR: this RF64 file has no ds64 chunk");
+            return false;
+        }
+
+        sampleDataSize = (size_t) ((uint64_t)readUInt32 (ds64 + 16) | ((uint64_t)readUInt32 (ds64 + 20) << 32));
+    }
+
+    numSamplesPerChannel = (int64_t) (sampleDataSize / numBytesPerBlock);
+
+    if (sampleDataIndex + (size_t)numSamplesPerChannel * numBytesPerBlock > fileSize)
+    {
+        reportError ("ERROR: read file error as the metadata indicates more samples than there are in the file data");
+        return false;
+    }
+
+    // -----------------------------------------------------------
+    // iXML CHUNK
+    if (indexOfXMLChunk != -1)
+        iXMLChunk = std::string ((const char*) fileData + indexOfXMLChunk + 8, readUInt32 (indexOfXMLChunk + 4));
+
+    return true;
+}
+
+//=============================================================
+template <class T>
+bool AudioFileReader<T>::parseAiffHeader()
+{
+    std::string format ((const char*) fileData + 8, 4);
+
+    int64_t indexOfCommChunk = getIndexOfChunk ("COMM", 12);
+    int64_t indexOfSoundDataChunk = getIndexOfChunk ("SSND", 12);
+    int64_t indexOfXMLChunk = getIndexOfChunk ("iXML", 12);
+
+    if (indexOfSoundDataChunk == -1 || indexOfCommChunk == -1 || (format != "AIFF" && format != "AIFC"))
+    {
+        reportError ("ERROR: this doesn't seem to be a valid AIFF file");
+        return false;
+    }
+
+    // -----------------------------------------------------------
+    // COMM CHUNK
+    int64_t p = indexOfCommChunk;
+    int16_t channels = (int16_t)readUInt16 (p + 8);
+    uint32_t numFrames = readUInt32 (p + 10);
+    bitDepth = (int16_t)readUInt16 (p + 14);
+    sampleRate = p + 26 <= (int64_t)fileSize ? static_cast<uint32_t> (AiffUtilities::decodeAiffSampleRate (fileData + p + 16)) : 0;
+
+    if (bitDepth > sizeof (T) * 8)
+    {
+        std::string message = "ERROR: you are trying to read a ";
+        message += std::to_string (bitDepth);
+        message += "-bit file using a ";
+        message += std::to_string (sizeof (T) * 8);
+        message += "-bit sample type";
+        reportError (message);
+        return false;
+    }
+
+    if (sampleRate == 0)
+    {
+        reportError ("ERROR: this AIFF file has an unsupported sample rate");
+        return false;
+    }
+
+    if (channels < 1 || channels > 2)
+    {
+        reportError ("ERROR: this AIFF file seems to be neither mono nor stereo (perhaps multi-track, or corrupted?)");
+        return false;
+    }
+
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
+    {
+        reportError ("ERROR: this file has a bit depth that is not 8, 16, 24 or 32 bits");
+        return false;
+    }
+
+    numChannels = channels;
+    encoding = AudioSampleKernels<T>::getEncoding (bitDepth, format == "AIFC", true);
+
+    // -----------------------------------------------------------
+    // SSND CHUNK
+    int64_t s = indexOfSoundDataChunk;
+    uint32_t soundDataChunkSize = readUInt32 (s + 4);
+    uint32_t offset = readUInt32 (s + 8);
+
+    size_t numBytesPerFrame = (size_t)numChannels * (bitDepth / 8);
+    sampleDataIndex = (size_t) (s + 16) + offset;
+    sampleDataSize = (size_t)numFrames * numBytesPerFrame;
+    numSamplesPerChannel = numFrames;
+
+    if ((soundDataChunkSize - 8) != sampleDataSize || sampleDataIndex + sampleDataSize > fileSize)
+    {
+        reportError ("ERROR: the metadatafor this file doesn't seem right");
+        return false;
+    }
+
+    // -----------------------------------------------------------
+    // iXML CHUNK
+    if (indexOfXMLChunk != -1)
+        iXMLChunk = std::string ((const char*) fileData + indexOfXMLChunk + 8, readUInt32 (indexOfXMLChunk + 4));
+
+    return true;
+}
+
+//=============================================================
+template <class T>
+int64_t AudioFileReader<T>::getIndexOfChunk (const char* chunkHeaderID, int64_t startIndex) const
+{
+    int64_t i = startIndex;
+
+    while (i + 8 <= (int64_t)fileSize)
+    {
+        if (memcmp (fileData + i, chunkHeaderID, 4) == 0)
+            return i;
+
+        int64_t chunkSize = readUInt32 (i + 4);
+
+        // Assume chunk size is invalid if it's greater than the number of bytes remaining
+        if (chunkSize > (int64_t)fileSize - i - 8)
+            return -1;
+
+        // chunks are padded to an even number of bytes
+        i += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    return -1;
+}
+
+//=============================================================
+template <class T>
+uint32_t AudioFileReader<T>::readUInt32 (int64_t index) const
+{
+    if (index < 0 || index + 4 > (int64_t)fileSize)
+        return 0;
+
+    const uint8_t* b = fileData + index;
+
+    if (bigEndian)
+        return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+    else
+        return ((uint32_t)b[3] << 24) | ((uint32_t)b[2] << 16) | ((uint32_t)b[1] << 8) | (uint32_t)b[0];
+}
+
+//=============================================================
+template <class T>
+uint16_t AudioFileReader<T>::readUInt16 (int64_t index) const
+{
+    if (index < 0 || index + 2 > (int64_t)fileSize)
+        return 0;
+
+    const uint8_t* b = fileData + index;
+
+    if (bigEndian)
+        return (uint16_t) ((b[0] << 8) | b[1]);
+    else
+        return (uint16_t) ((b[1] << 8) | b[0]);
+}
+
+//=============================================================
+template <class T>
+void AudioFileReader<T>::reportError (const std::string& errorMessage)
+{
+    if (logErrorsToConsole)
+        std::cerr << errorMessage << std::endl;
+}
+
+//=============================================================
+template <typename SignedType>
+typename std::make_unsigned<SignedType>::type convertSignedToUnsigned (SignedType signedValue)
+{
+    static_assert (std::is_signed<SignedType>::value, "The input value must be signed");
+    
+    typename std::make_unsigned<SignedType>::type unsignedValue = static_cast<typename std::make_unsigned<SignedType>::type> (1) + std::numeric_limits<SignedType>::max();
+    
+    unsignedValue += signedValue;
+    return unsignedValue;
+}
+
+//=============================================================
+enum SampleLimit
+{
+    SignedInt16_Min = -32768,
+    SignedInt16_Max = 32767,
+    UnsignedInt16_Min = 0,
+    UnsignedInt16_Max = 65535,
+    SignedInt24_Min = -8388608,
+    SignedInt24_Max = 8388607,
+    UnsignedInt24_Min = 0,
+    UnsignedInt24_Max = 16777215
+};
+
+//=============================================================
+template <class T>
+T AudioSampleConverter<T>::thirtyTwoBitIntToSample (int32_t sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        return static_cast<T> (sample) / static_cast<T> (std::numeric_limits<int32_t>::max());
+    }
+    else if (std::numeric_limits<T>::is_integer)
+    {
+        if constexpr (std::is_signed_v<T>)
+			return static_cast<T> (sample);
+        else
+            return static_cast<T> (clamp (static_cast<T> (sample + 2147483648), 0, 4294967295));
+    }
+}
+
+//=============================================================
+template <class T>
+int32_t AudioSampleConverter<T>::sampleToThirtyTwoBitInt (T sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        // multiplying a float by a the max int32_t is problematic because
+        // of roundng errors which can cause wrong values to come out, so
+        // we use a different implementation here compared to other types
+        if constexpr (std::is_same_v<T, float>)
+        {
+            if (sample >= 1.f)
+                return std::numeric_limits<int32_t>::max();
+            else if (sample <= -1.f)
+                return std::numeric_limits<int32_t>::lowest() + 1; // starting at 1 preserves symmetry
+            else
+                return static_cast<int32_t> (sample * std::numeric_limits<int32_t>::max());
+        }
+        else
+        {
+            return static_cast<int32_t> (clamp (sample, -1., 1.) * std::numeric_limits<int32_t>::max());
+        }
+    }
+    else
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<int32_t> (clamp (sample, -2147483648LL, 2147483647LL));
+        else
+            return static_cast<int32_t> (clamp (sample, 0, 4294967295) - 2147483648);
+    }
+}
+
+//=============================================================
+template <class T>
+T AudioSampleConverter<T>::twentyFourBitIntToSample (int32_t sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        return static_cast<T> (sample) / static_cast<T> (8388607.);
+    }
+    else if (std::numeric_limits<T>::is_integer)
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<T> (clamp (sample, SignedInt24_Min, SignedInt24_Max));
+        else
+            return static_cast<T> (clamp (sample + 8388608, UnsignedInt24_Min, UnsignedInt24_Max));
+    }
+}
+
+//=============================================================
+template <class T>
+int32_t AudioSampleConverter<T>::sampleToTwentyFourBitInt (T sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        sample = clamp (sample, -1., 1.);
+        return static_cast<int32_t> (sample * 8388607.);
+    }
+    else
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<int32_t> (clamp (sample, SignedInt24_Min, SignedInt24_Max));
+        else
+            return static_cast<int32_t> (clamp (sample, UnsignedInt24_Min, UnsignedInt24_Max) + SignedInt24_Min);
+    }
+}
+
+//=============================================================
+template <class T>
+T AudioSampleConverter<T>::sixteenBitIntToSample (int16_t sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        return static_cast<T> (sample) / static_cast<T> (32767.);
+    }
+    else if constexpr (std::numeric_limits<T>::is_integer)
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<T> (sample);
+        else
+            return static_cast<T> (convertSignedToUnsigned<int16_t> (sample));
+    }
+}
+
+//=============================================================
+template <class T>
+int16_t AudioSampleConverter<T>::sampleToSixteenBitInt (T sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        sample = clamp (sample, -1., 1.);
+        return static_cast<int16_t> (sample * 32767.);
+    }
+    else
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<int16_t> (clamp (sample, SignedInt16_Min, SignedInt16_Max));
+        else
+            return static_cast<int16_t> (clamp (sample, UnsignedInt16_Min, UnsignedInt16_Max) + SignedInt16_Min);
+    }
+}
+
+//=============================================================
+template <class T>
+uint8_t AudioSampleConverter<T>::sampleToUnsignedByte (T sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        sample = clamp (sample, -1., 1.);
+        sample = (sample + 1.) / 2.;
+        return static_cast<uint8_t> (1 + (sample * 254));
+    }
+    else
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<uint8_t> (clamp (sample, -128, 127) + 128);
+        else
+            return static_cast<uint8_t> (clamp (sample, 0, 255));
+    }
+}
+
+//=============================================================
+template <class T>
+int8_t AudioSampleConverter<T>::sampleToSignedByte (T sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        sample = clamp (sample, -1., 1.);
+        return static_cast<int8_t> (sample * (T)0x7F);
+    }
+    else
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<int8_t> (clamp (sample, -128, 127));
+        else
+            return static_cast<int8_t> (clamp (sample, 0, 255) - 128);
+    }
+}
+
+//=============================================================
+template <class T>
+T AudioSampleConverter<T>::unsignedByteToSample (uint8_t sample)
+{
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        return static_cast<T> (sample - 128) / static_cast<T> (127.);
+    }
+    else if (std::numeric_limits<T>::is_integer)
+    {
+        if constexpr (std::is_unsigned_v<T>)
+            return static_cast<T> (sample);
+        else
+            return static_cast<T> (sample - 128);
+    }
+}
+
+//=============================================================
+template <class T>
+T AudioSampleConverter<T>::signedByteToSample (int8_t sample)
 {
     if constexpr (std::is_floating_point<T>::value)
     {
@@ -1549,6 +2662,589 @@ T AudioSampleConverter<T>::clamp (T value, T minValue, T maxValue)
     return value;
 }
 
+//=============================================================
+template <class T>
+SampleEncoding AudioSampleKernels<T>::getEncoding (int bitDepth, bool isFloat, bool isSigned8Bit)
+{
+    if (bitDepth == 8)
+        return isSigned8Bit ? SampleEncoding::SignedInt8 : SampleEncoding::UnsignedInt8;
+    else if (bitDepth == 16)
+        return SampleEncoding::Int16;
+    else if (bitDepth == 24)
+        return SampleEncoding::Int24;
+    else
+        return isFloat ? SampleEncoding::Float32 : SampleEncoding::Int32;
+}
+
+//=============================================================
+template <class T>
+int AudioSampleKernels<T>::getBytesPerSample (SampleEncoding encoding)
+{
+    switch (encoding)
+    {
+        case SampleEncoding::UnsignedInt8:
+        case SampleEncoding::SignedInt8: return 1;
+        case SampleEncoding::Int16: return 2;
+        case SampleEncoding::Int24: return 3;
+        default: return 4;
+    }
+}
+
+//=============================================================
+template <class T>
+void AudioSampleKernels<T>::decode (const uint8_t* source, SampleEncoding encoding, bool bigEndian, int numChannels, int64_t numFrames, T* const* destination)
+{
+    int64_t startFrame = 0;
+
+    if (! bigEndian)
+        startFrame = decodeFramesSIMD (source, encoding, numChannels, numFrames, destination);
+
+    if (startFrame >= numFrames)
+        return;
+
+    switch (encoding)
+    {
+        case SampleEncoding::UnsignedInt8: decodeFrames<SampleEncoding::UnsignedInt8, false> (source, numChannels, startFrame, numFrames, destination); break;
+        case SampleEncoding::SignedInt8: decodeFrames<SampleEncoding::SignedInt8, false> (source, numChannels, startFrame, numFrames, destination); break;
+        case SampleEncoding::Int16:
+            if (bigEndian) decodeFrames<SampleEncoding::Int16, true> (source, numChannels, startFrame, numFrames, destination);
+            else decodeFrames<SampleEncoding::Int16, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+        case SampleEncoding::Int24:
+            if (bigEndian) decodeFrames<SampleEncoding::Int24, true> (source, numChannels, startFrame, numFrames, destination);
+            else decodeFrames<SampleEncoding::Int24, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+        case SampleEncoding::Int32:
+            if (bigEndian) decodeFrames<SampleEncoding::Int32, true> (source, numChannels, startFrame, numFrames, destination);
+            else decodeFrames<SampleEncoding::Int32, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+        case SampleEncoding::Float32:
+            if (bigEndian) decodeFrames<SampleEncoding::Float32, true> (source, numChannels, startFrame, numFrames, destination);
+            else decodeFrames<SampleEncoding::Float32, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+    }
+}
+
+//=============================================================
+template <class T>
+template <SampleEncoding encoding, bool bigEndian>
+T AudioSampleKernels<T>::decodeSample (const uint8_t* bytes)
+{
+    if constexpr (encoding == SampleEncoding::UnsignedInt8)
+    {
+        return AudioSampleConverter<T>::unsignedByteToSample (bytes[0]);
+    }
+    else if constexpr (encoding == SampleEncoding::SignedInt8)
+    {
+        return AudioSampleConverter<T>::signedByteToSample (static_cast<int8_t> (bytes[0]));
+    }
+    else if constexpr (encoding == SampleEncoding::Int16)
+    {
+        int16_t sampleAsInt = bigEndian ? (int16_t) ((bytes[0] << 8) | bytes[1]) : (int16_t) ((bytes[1] << 8) | bytes[0]);
+        return AudioSampleConverter<T>::sixteenBitIntToSample (sampleAsInt);
+    }
+    else if constexpr (encoding == SampleEncoding::Int24)
+    {
+        int32_t sampleAsInt = bigEndian ? ((bytes[0] << 16) | (bytes[1] << 8) | bytes[2]) : ((bytes[2] << 16) | (bytes[1] << 8) | bytes[0]);
+
+        if (sampleAsInt & 0x800000) //  if the 24th bit is set, this is a negative number in 24-bit world
+            sampleAsInt = sampleAsInt | ~0xFFFFFF; // so make sure sign is extended to the 32 bit float
+
+        return AudioSampleConverter<T>::twentyFourBitIntToSample (sampleAsInt);
+    }
+    else
+    {
+        uint32_t bits = bigEndian ? (((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3])
+                                  : (((uint32_t)bytes[3] << 24) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[1] << 8) | (uint32_t)bytes[0]);
+
+        if constexpr (encoding == SampleEncoding::Float32)
+        {
+            float f;
+            memcpy (&f, &bits, sizeof (uint32_t));
+            return (T)f;
+        }
+        else
+        {
+            return AudioSampleConverter<T>::thirtyTwoBitIntToSample (static_cast<int32_t> (bits));
+        }
+    }
+}
+
+//=============================================================
+template <class T>
+template <SampleEncoding encoding, bool bigEndian>
+void AudioSampleKernels<T>::decodeFrames (const uint8_t* source, int numChannels, int64_t startFrame, int64_t numFrames, T* const* destination)
+{
+    const int numBytesPerSample = getBytesPerSample (encoding);
+    const int64_t numBytesPerFrame = (int64_t)numBytesPerSample * numChannels;
+
+    if (numChannels == 1)
+    {
+        T* d0 = destination[0];
+
+        for (int64_t i = startFrame; i < numFrames; i++)
+            d0[i] = decodeSample<encoding, bigEndian> (source + i * numBytesPerSample);
+    }
+    else if (numChannels == 2)
+    {
+        T* d0 = destination[0];
+        T* d1 = destination[1];
+
+        for (int64_t i = startFrame; i < numFrames; i++)
+        {
+            const uint8_t* frame = source + i * numBytesPerFrame;
+            d0[i] = decodeSample<encoding, bigEndian> (frame);
+            d1[i] = decodeSample<encoding, bigEndian> (frame + numBytesPerSample);
+        }
+    }
+    else
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            T* d = destination[channel];
+            const uint8_t* bytes = source + channel * numBytesPerSample;
+
+            for (int64_t i = startFrame; i < numFrames; i++)
+                d[i] = decodeSample<encoding, bigEndian> (bytes + i * numBytesPerFrame);
+        }
+    }
+}
+
+//=============================================================
+template <class T>
+int64_t AudioSampleKernels<T>::decodeFramesSIMD (const uint8_t* source, SampleEncoding encoding, int numChannels, int64_t numFrames, T* const* destination)
+{
+    int64_t i = 0;
+
+#if defined (AUDIOFILE_SSE2)
+    // the scale factors and the order of operations match AudioSampleConverter exactly, so
+    // these kernels produce the same values as the scalar conversion
+    if constexpr (std::is_same_v<T, float>)
+    {
+        float* d0 = destination[0];
+        float* d1 = numChannels == 2 ? destination[1] : nullptr;
+
+        if (encoding == SampleEncoding::Int16)
+        {
+            const __m128 scale = _mm_set1_ps (32767.f);
+
+            if (numChannels == 1)
+            {
+#if defined (AUDIOFILE_AVX2)
+                const __m256 scale8 = _mm256_set1_ps (32767.f);
+
+                for (; i + 8 <= numFrames; i += 8)
+                {
+                    __m256i v = _mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i*) (source + i * 2)));
+                    _mm256_storeu_ps (d0 + i, _mm256_div_ps (_mm256_cvtepi32_ps (v), scale8));
+                }
+#endif
+                for (; i + 8 <= numFrames; i += 8)
+                {
+                    __m128i v = _mm_loadu_si128 ((const __m128i*) (source + i * 2));
+                    __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+                    __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+                    _mm_storeu_ps (d0 + i, _mm_div_ps (_mm_cvtepi32_ps (lo), scale));
+                    _mm_storeu_ps (d0 + i + 4, _mm_div_ps (_mm_cvtepi32_ps (hi), scale));
+                }
+            }
+            else if (numChannels == 2)
+            {
+#if defined (AUDIOFILE_AVX2)
+                const __m256 scale8 = _mm256_set1_ps (32767.f);
+
+                for (; i + 8 <= numFrames; i += 8)
+                {
+                    __m256i v = _mm256_loadu_si256 ((const __m256i*) (source + i * 4));
+                    __m256i l = _mm256_srai_epi32 (_mm256_slli_epi32 (v, 16), 16);
+                    __m256i r = _mm256_srai_epi32 (v, 16);
+                    _mm256_storeu_ps (d0 + i, _mm256_div_ps (_mm256_cvtepi32_ps (l), scale8));
+                    _mm256_storeu_ps (d1 + i, _mm256_div_ps (_mm256_cvtepi32_ps (r), scale8));
+                }
+#endif
+                for (; i + 4 <= numFrames; i += 4)
+                {
+                    __m128i v = _mm_loadu_si128 ((const __m128i*) (source + i * 4));
+                    __m128i l = _mm_srai_epi32 (_mm_slli_epi32 (v, 16), 16);
+                    __m128i r = _mm_srai_epi32 (v, 16);
+                    _mm_storeu_ps (d0 + i, _mm_div_ps (_mm_cvtepi32_ps (l), scale));
+                    _mm_storeu_ps (d1 + i, _mm_div_ps (_mm_cvtepi32_ps (r), scale));
+                }
+            }
+        }
+        else if (encoding == SampleEncoding::Float32 || encoding == SampleEncoding::Int32)
+        {
+            const bool isFloat = encoding == SampleEncoding::Float32;
+            const __m128 scale = _mm_set1_ps (static_cast<float> (std::numeric_limits<int32_t>::max()));
+
+            if (numChannels == 1)
+            {
+                if (isFloat)
+                {
+                    memcpy (d0, source, (size_t)numFrames * sizeof (float));
+                    return numFrames;
+                }
+
+                for (; i + 4 <= numFrames; i += 4)
+                {
+                    __m128i v = _mm_loadu_si128 ((const __m128i*) (source + i * 4));
+                    _mm_storeu_ps (d0 + i, _mm_div_ps (_mm_cvtepi32_ps (v), scale));
+                }
+            }
+            else if (numChannels == 2)
+            {
+                for (; i + 4 <= numFrames; i += 4)
+                {
+                    __m128 a = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i*) (source + i * 8)));
+                    __m128 b = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i*) (source + i * 8 + 16)));
+                    __m128 l = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+                    __m128 r = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+
+                    if (! isFloat)
+                    {
+                        l = _mm_div_ps (_mm_cvtepi32_ps (_mm_castps_si128 (l)), scale);
+                        r = _mm_div_ps (_mm_cvtepi32_ps (_mm_castps_si128 (r)), scale);
+                    }
+
+                    _mm_storeu_ps (d0 + i, l);
+                    _mm_storeu_ps (d1 + i, r);
+                }
+            }
+        }
+        else if (encoding == SampleEncoding::UnsignedInt8)
+        {
+            const __m128 scale = _mm_set1_ps (127.f);
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i offset16 = _mm_set1_epi16 (128);
+            const __m128i offset32 = _mm_set1_epi32 (128);
+            const __m128i lowMask = _mm_set1_epi32 (0xFFFF);
+
+            if (numChannels == 1)
+            {
+                for (; i + 16 <= numFrames; i += 16)
+                {
+                    __m128i v = _mm_loadu_si128 ((const __m128i*) (source + i));
+                    __m128i halves[2] = { _mm_sub_epi16 (_mm_unpacklo_epi8 (v, zero), offset16),
+                                          _mm_sub_epi16 (_mm_unpackhi_epi8 (v, zero), offset16) };
+
+                    for (int h = 0; h < 2; h++)
+                    {
+                        __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (halves[h], halves[h]), 16);
+                        __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (halves[h], halves[h]), 16);
+                        _mm_storeu_ps (d0 + i + h * 8, _mm_div_ps (_mm_cvtepi32_ps (lo), scale));
+                        _mm_storeu_ps (d0 + i + h * 8 + 4, _mm_div_ps (_mm_cvtepi32_ps (hi), scale));
+                    }
+                }
+            }
+            else if (numChannels == 2)
+            {
+                for (; i + 8 <= numFrames; i += 8)
+                {
+                    __m128i v = _mm_loadu_si128 ((const __m128i*) (source + i * 2));
+                    __m128i halves[2] = { _mm_unpacklo_epi8 (v, zero), _mm_unpackhi_epi8 (v, zero) };
+
+                    for (int h = 0; h < 2; h++)
+                    {
+                        __m128i l = _mm_sub_epi32 (_mm_and_si128 (halves[h], lowMask), offset32);
+                        __m128i r = _mm_sub_epi32 (_mm_srli_epi32 (halves[h], 16), offset32);
+                        _mm_storeu_ps (d0 + i + h * 4, _mm_div_ps (_mm_cvtepi32_ps (l), scale));
+                        _mm_storeu_ps (d1 + i + h * 4, _mm_div_ps (_mm_cvtepi32_ps (r), scale));
+                    }
+                }
+            }
+        }
+#if defined (AUDIOFILE_SSSE3)
+        else if (encoding == SampleEncoding::Int24)
+        {
+            // move each 3-byte sample into the top of a 32-bit lane, then shift it back down to sign extend it
+            const __m128i spread = _mm_setr_epi8 (-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+            const __m128 scale = _mm_set1_ps (8388607.f);
+
+            if (numChannels == 1)
+            {
+                // each load reads 16 bytes but only uses 12, so stop before that could run past the data
+                for (; i + 6 <= numFrames; i += 4)
+                {
+                    __m128i v = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i*) (source + i * 3)), spread);
+                    _mm_storeu_ps (d0 + i, _mm_div_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (v, 8)), scale));
+                }
+            }
+            else if (numChannels == 2)
+            {
+                for (; i + 5 <= numFrames; i += 4)
+                {
+                    __m128 a = _mm_castsi128_ps (_mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i*) (source + i * 6)), spread));
+                    __m128 b = _mm_castsi128_ps (_mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i*) (source + i * 6 + 12)), spread));
+                    __m128i l = _mm_srai_epi32 (_mm_castps_si128 (_mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0))), 8);
+                    __m128i r = _mm_srai_epi32 (_mm_castps_si128 (_mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1))), 8);
+                    _mm_storeu_ps (d0 + i, _mm_div_ps (_mm_cvtepi32_ps (l), scale));
+                    _mm_storeu_ps (d1 + i, _mm_div_ps (_mm_cvtepi32_ps (r), scale));
+                }
+            }
+        }
+#endif
+    }
+#else
+    (void)source; (void)encoding; (void)numChannels; (void)numFrames; (void)destination;
+#endif
+
+    return i;
+}
+
+//=============================================================
+template <class T>
+void AudioSampleKernels<T>::encode (const T* const* source, int numChannels, int64_t numFrames, SampleEncoding encoding, bool bigEndian, uint8_t* destination, TpdfDither* dither)
+{
+    // integer samples are already quantised, and only 16-bit output is dithered
+    if (! std::is_floating_point_v<T> || encoding != SampleEncoding::Int16)
+        dither = nullptr;
+
+    int64_t startFrame = 0;
+
+    if (! bigEndian)
+        startFrame = encodeFramesSIMD (source, numChannels, numFrames, encoding, destination, dither);
+
+    if (startFrame >= numFrames)
+        return;
+
+    if (dither != nullptr)
+    {
+        encodeFramesDithered (source, numChannels, startFrame, numFrames, bigEndian, destination, *dither);
+        return;
+    }
+
+    switch (encoding)
+    {
+        case SampleEncoding::UnsignedInt8: encodeFrames<SampleEncoding::UnsignedInt8, false> (source, numChannels, startFrame, numFrames, destination); break;
+        case SampleEncoding::SignedInt8: encodeFrames<SampleEncoding::SignedInt8, false> (source, numChannels, startFrame, numFrames, destination); break;
+        case SampleEncoding::Int16:
+            if (bigEndian) encodeFrames<SampleEncoding::Int16, true> (source, numChannels, startFrame, numFrames, destination);
+            else encodeFrames<SampleEncoding::Int16, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+        case SampleEncoding::Int24:
+            if (bigEndian) encodeFrames<SampleEncoding::Int24, true> (source, numChannels, startFrame, numFrames, destination);
+            else encodeFrames<SampleEncoding::Int24, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+        case SampleEncoding::Int32:
+            if (bigEndian) encodeFrames<SampleEncoding::Int32, true> (source, numChannels, startFrame, numFrames, destination);
+            else encodeFrames<SampleEncoding::Int32, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+        case SampleEncoding::Float32:
+            if (bigEndian) encodeFrames<SampleEncoding::Float32, true> (source, numChannels, startFrame, numFrames, destination);
+            else encodeFrames<SampleEncoding::Float32, false> (source, numChannels, startFrame, numFrames, destination);
+            break;
+    }
+}
+
+//=============================================================
+template <class T>
+template <SampleEncoding encoding, bool bigEndian>
+void AudioSampleKernels<T>::encodeSample (T sample, uint8_t* bytes)
+{
+    if constexpr (encoding == SampleEncoding::UnsignedInt8)
+    {
+        bytes[0] = AudioSampleConverter<T>::sampleToUnsignedByte (sample);
+    }
+    else if constexpr (encoding == SampleEncoding::SignedInt8)
+    {
+        bytes[0] = static_cast<uint8_t> (AudioSampleConverter<T>::sampleToSignedByte (sample));
+    }
+    else if constexpr (encoding == SampleEncoding::Int16)
+    {
+        uint16_t sampleAsInt = static_cast<uint16_t> (AudioSampleConverter<T>::sampleToSixteenBitInt (sample));
+        bytes[bigEndian ? 1 : 0] = (uint8_t) (sampleAsInt & 0xFF);
+        bytes[bigEndian ? 0 : 1] = (uint8_t) (sampleAsInt >> 8);
+    }
+    else if constexpr (encoding == SampleEncoding::Int24)
+    {
+        int32_t sampleAsInt = AudioSampleConverter<T>::sampleToTwentyFourBitInt (sample);
+        bytes[bigEndian ? 2 : 0] = (uint8_t) (sampleAsInt & 0xFF);
+        bytes[1] = (uint8_t) ((sampleAsInt >> 8) & 0xFF);
+        bytes[bigEndian ? 0 : 2] = (uint8_t) ((sampleAsInt >> 16) & 0xFF);
+    }
+    else
+    {
+        uint32_t bits;
+
+        if constexpr (encoding == SampleEncoding::Float32)
+        {
+            float sampleAsFloat = (float) sample;
+            memcpy (&bits, &sampleAsFloat, sizeof (uint32_t));
+        }
+        else
+        {
+            bits = static_cast<uint32_t> (AudioSampleConverter<T>::sampleToThirtyTwoBitInt (sample));
+        }
+
+        for (int j = 0; j < 4; j++)
+            bytes[bigEndian ? 3 - j : j] = (uint8_t) ((bits >> (8 * j)) & 0xFF);
+    }
+}
+
+//=============================================================
+template <class T>
+template <SampleEncoding encoding, bool bigEndian>
+void AudioSampleKernels<T>::encodeFrames (const T* const* source, int numChannels, int64_t startFrame, int64_t numFrames, uint8_t* destination)
+{
+    const int numBytesPerSample = getBytesPerSample (encoding);
+    const int64_t numBytesPerFrame = (int64_t)numBytesPerSample * numChannels;
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        const T* s = source[channel];
+        uint8_t* bytes = destination + channel * numBytesPerSample;
+
+        for (int64_t i = startFrame; i < numFrames; i++)
+            encodeSample<encoding, bigEndian> (s[i], bytes + i * numBytesPerFrame);
+    }
+}
+
+//=============================================================
+template <class T>
+void AudioSampleKernels<T>::encodeFramesDithered (const T* const* source, int numChannels, int64_t startFrame, int64_t numFrames, bool bigEndian, uint8_t* destination, TpdfDither& dither)
+{
+    for (int64_t i = startFrame; i < numFrames; i++)
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            float value = (float) AudioSampleConverter<T>::clamp (source[channel][i], -1., 1.) * 32767.f + dither.next();
+            long rounded = std::lrint (value);
+            uint16_t sampleAsInt = static_cast<uint16_t> (static_cast<int16_t> (std::min (std::max (rounded, -32768L), 32767L)));
+
+            uint8_t* bytes = destination + (i * numChannels + channel) * 2;
+            bytes[bigEndian ? 1 : 0] = (uint8_t) (sampleAsInt & 0xFF);
+            bytes[bigEndian ? 0 : 1] = (uint8_t) (sampleAsInt >> 8);
+        }
+    }
+}
+
+//=============================================================
+template <class T>
+int64_t AudioSampleKernels<T>::encodeFramesSIMD (const T* const* source, int numChannels, int64_t numFrames, SampleEncoding encoding, uint8_t* destination, TpdfDither* dither)
+{
+    int64_t i = 0;
+
+#if defined (AUDIOFILE_SSE2)
+    if constexpr (std::is_same_v<T, float>)
+    {
+        const float* s0 = source[0];
+        const float* s1 = numChannels == 2 ? source[1] : nullptr;
+
+        if (encoding == SampleEncoding::Int16 && (numChannels == 1 || numChannels == 2))
+        {
+            const __m128 minusOne = _mm_set1_ps (-1.f);
+            const __m128 one = _mm_set1_ps (1.f);
+            const __m128 scale = _mm_set1_ps (32767.f);
+            const __m128 noiseScale = _mm_set1_ps (1.0f / 16777216.0f);
+            __m128i state = dither != nullptr ? _mm_loadu_si128 ((const __m128i*) dither->state) : _mm_setzero_si128();
+
+            auto clamp = [&] (__m128 x) { return _mm_max_ps (_mm_min_ps (x, one), minusOne); };
+
+            // the undithered conversion multiplies in double precision and truncates, exactly like sampleToSixteenBitInt()
+            auto truncate = [] (__m128 x) {
+#if defined (AUDIOFILE_AVX2)
+                return _mm256_cvttpd_epi32 (_mm256_mul_pd (_mm256_cvtps_pd (x), _mm256_set1_pd (32767.)));
+#else
+                const __m128d scaleD = _mm_set1_pd (32767.);
+                __m128i lo = _mm_cvttpd_epi32 (_mm_mul_pd (_mm_cvtps_pd (x), scaleD));
+                __m128i hi = _mm_cvttpd_epi32 (_mm_mul_pd (_mm_cvtps_pd (_mm_movehl_ps (x, x)), scaleD));
+                return _mm_unpacklo_epi64 (lo, hi);
+#endif
+            };
+
+            auto uniform = [&] () {
+                state = _mm_xor_si128 (state, _mm_slli_epi32 (state, 13));
+                state = _mm_xor_si128 (state, _mm_srli_epi32 (state, 17));
+                state = _mm_xor_si128 (state, _mm_slli_epi32 (state, 5));
+                return _mm_mul_ps (_mm_cvtepi32_ps (_mm_srli_epi32 (state, 8)), noiseScale);
+            };
+
+            // the dithered conversion adds the noise and rounds to the nearest value, letting the pack saturate
+            auto quantise = [&] (__m128 x) {
+                x = clamp (x);
+
+                if (dither == nullptr)
+                    return truncate (x);
+
+                __m128 noise = _mm_sub_ps (uniform(), uniform());
+                return _mm_cvtps_epi32 (_mm_add_ps (_mm_mul_ps (x, scale), noise));
+            };
+
+            if (numChannels == 1)
+            {
+                for (; i + 8 <= numFrames; i += 8)
+                {
+                    __m128i a = quantise (_mm_loadu_ps (s0 + i));
+                    __m128i b = quantise (_mm_loadu_ps (s0 + i + 4));
+                    _mm_storeu_si128 ((__m128i*) (destination + i * 2), _mm_packs_epi32 (a, b));
+                }
+            }
+            else
+            {
+                for (; i + 4 <= numFrames; i += 4)
+                {
+                    __m128i l = quantise (_mm_loadu_ps (s0 + i));
+                    __m128i r = quantise (_mm_loadu_ps (s1 + i));
+                    __m128i lo = _mm_unpacklo_epi32 (l, r);
+                    __m128i hi = _mm_unpackhi_epi32 (l, r);
+                    _mm_storeu_si128 ((__m128i*) (destination + i * 4), _mm_packs_epi32 (lo, hi));
+                }
+            }
+
+            if (dither != nullptr)
+                _mm_storeu_si128 ((__m128i*) dither->state, state);
+        }
+        else if (encoding == SampleEncoding::Float32)
+        {
+            if (numChannels == 1)
+            {
+                memcpy (destination, s0, (size_t)numFrames * sizeof (float));
+                return numFrames;
+            }
+            else if (numChannels == 2)
+            {
+                for (; i + 4 <= numFrames; i += 4)
+                {
+                    __m128 l = _mm_loadu_ps (s0 + i);
+                    __m128 r = _mm_loadu_ps (s1 + i);
+                    _mm_storeu_ps ((float*) (destination + i * 8), _mm_unpacklo_ps (l, r));
+                    _mm_storeu_ps ((float*) (destination + i * 8 + 16), _mm_unpackhi_ps (l, r));
+                }
+            }
+        }
+    }
+#else
+    (void)source; (void)numChannels; (void)numFrames; (void)encoding; (void)destination; (void)dither;
+#endif
+
+    return i;
+}
+
+//=============================================================
+inline TpdfDither::TpdfDither (uint32_t seed)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        state[i] = seed != 0 ? seed : 1;
+    }
+}
+
+//=============================================================
+inline float TpdfDither::next()
+{
+    auto uniform = [this] (int lane) {
+        uint32_t x = state[lane];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state[lane] = x;
+        return (float) (x >> 8) * (1.0f / 16777216.0f);
+    };
+
+    return uniform (0) - uniform (1);
+}
+
 //=============================================================
 inline double AiffUtilities::decodeAiffSampleRate (const uint8_t* bytes)
 {
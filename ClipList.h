@@ -0,0 +1,400 @@
+﻿#pragma once
+#include "AudioFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+struct AudioClip {
+    std::string filename="";
+    double startTime=0.0; // 秒；用 double 保存，几十小时的时间线上也能精确到采样
+    float volume=.0f;
+    double offset=0.0;    // 只用源文件从这里（秒）开始的一段
+    double length=-1.0;   // 这一段的长度（秒），小于 0 表示到文件末尾
+    int64_t repeat=1;     // 从 startTime 起每隔 period 秒放置一次，共 repeat 次，各次共用同一份音源
+    double period=0.0;
+
+    bool isSlice() const { return offset > 0.0 || length >= 0.0; }
+};
+
+// 片段截取的源文件采样范围 [startSample, startSample + numSamples)，按源文件的采样率计算并限制在文件之内
+inline void clipSourceRange(const AudioClip& clip, uint32_t sourceRate, int64_t sourceSamples, int64_t& startSample, int64_t& numSamples)
+{
+    startSample = std::min(static_cast<int64_t>(std::llround(clip.offset * sourceRate)), sourceSamples);
+    numSamples = sourceSamples - startSample;
+    if (clip.length >= 0.0) {
+        numSamples = std::min(static_cast<int64_t>(std::llround(clip.length * sourceRate)), numSamples);
+    }
+}
+
+// 片段列表的读写。文本格式是每三个以空白分隔的字段一组：<wavfile> <starttime> <volume>，
+// 后面可以跟 offset=<秒>、length=<秒> 只截取源文件的一段，repeat=<次数>、period=<秒> 重复放置；
+// 二进制格式（文件以 "WCCL" 开头）由路径表和定长记录组成，加载时不需要任何解析：
+//   0   "WCCL"、uint32 版本、uint32 路径数、uint32 保留
+//   16  uint64 片段数、uint64 路径字符串总字节数
+//   32  uint64 路径偏移[路径数 + 1]（相对字符串区起点），随后是字符串区，补齐到 8 字节
+//   ... Record[片段数]：uint32 路径下标、float 音量、double 开始时间；
+//       版本 2 的每条记录后面再跟 double 截取起点、double 截取长度，
+//       版本 3 再跟 double 重复间隔、int64 重复次数（只写能容纳列表的最低版本）
+class ClipList {
+public:
+    static constexpr uint32_t version = 3;
+
+    struct Record {
+        uint32_t path;
+        float volume;
+        double startTime;
+    };
+    static_assert(sizeof(Record) == 16, "Record must be packed to 16 bytes");
+
+    struct SliceRecord {
+        Record record;
+        double offset;
+        double length;
+    };
+    static_assert(sizeof(SliceRecord) == 32, "SliceRecord must be packed to 32 bytes");
+
+    struct RepeatRecord {
+        SliceRecord slice;
+        double period;
+        int64_t repeat;
+    };
+    static_assert(sizeof(RepeatRecord) == 48, "RepeatRecord must be packed to 48 bytes");
+
+    // 片段（最后一次放置）开始时间的上限，约 31 年；最高采样率 384 kHz 下也远在 int64 采样数的范围之内
+    static constexpr double maxStartTime = 1e9;
+
+    // 读取片段列表，按文件头自动识别文本或二进制格式；文本较大时用 jobs 个线程并行解析
+    static std::vector<AudioClip> load(const std::string& path, int jobs)
+    {
+        MappedFile mapped;
+        if (!mapped.open(path)) {
+            // 空文件无法映射，但仍是合法的（空）列表
+            std::ifstream file(path);
+            if (!file.is_open()) {
+                throw std::runtime_error("Cannot open file: " + path);
+            }
+            return {};
+        }
+        return parse(mapped.data(), mapped.size(), jobs);
+    }
+
+    // 解析内存中的片段列表（文本或二进制格式），格式错误或重复放置的参数不合理时抛出 std::runtime_error
+    static std::vector<AudioClip> parse(const uint8_t* data, size_t size, int jobs)
+    {
+        const char* text = reinterpret_cast<const char*>(data);
+        std::vector<AudioClip> clips = size >= 4 && std::memcmp(text, "WCCL", 4) == 0 ? loadBinary(data, size) : parseText(text, size, jobs);
+        for (size_t i = 0; i < clips.size(); ++i) {
+            validatePlacement(clips[i], i);
+        }
+        return clips;
+    }
+
+    // 以二进制格式保存，相同的路径只存一份
+    static bool saveBinary(const std::string& path, const std::vector<AudioClip>& clips)
+    {
+        std::vector<const std::string*> paths;
+        std::vector<Record> records(clips.size());
+        const bool repeated = std::any_of(clips.begin(), clips.end(), [](const AudioClip& clip) { return clip.repeat != 1; });
+        const bool sliced = repeated || std::any_of(clips.begin(), clips.end(), [](const AudioClip& clip) { return clip.isSlice(); });
+        const uint32_t fileVersion = repeated ? 3 : sliced ? 2 : 1;
+        {
+            std::unordered_map<std::string_view, uint32_t> indices;
+            for (size_t i = 0; i < clips.size(); ++i) {
+                auto inserted = indices.emplace(clips[i].filename, static_cast<uint32_t>(paths.size()));
+                if (inserted.second) {
+                    paths.push_back(&clips[i].filename);
+                }
+                records[i] = { inserted.first->second, clips[i].volume, clips[i].startTime };
+            }
+        }
+        std::vector<uint64_t> offsets(1, 0);
+        for (const std::string* p : paths) {
+            offsets.push_back(offsets.back() + p->size());
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        uint32_t header[4] = { 0, fileVersion, static_cast<uint32_t>(paths.size()), 0 };
+        std::memcpy(header, "WCCL", 4);
+        const uint64_t counts[2] = { static_cast<uint64_t>(clips.size()), offsets.back() };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+        file.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+        for (const std::string* p : paths) {
+            file.write(p->data(), static_cast<std::streamsize>(p->size()));
+        }
+        const char padding[8] = {};
+        file.write(padding, static_cast<std::streamsize>((8 - offsets.back() % 8) % 8));
+        if (repeated) {
+            std::vector<RepeatRecord> repeatRecords(clips.size());
+            for (size_t i = 0; i < clips.size(); ++i) {
+                repeatRecords[i] = { { records[i], clips[i].offset, clips[i].length }, clips[i].period, clips[i].repeat };
+            }
+            file.write(reinterpret_cast<const char*>(repeatRecords.data()), static_cast<std::streamsize>(repeatRecords.size() * sizeof(RepeatRecord)));
+        }
+        else if (sliced) {
+            std::vector<SliceRecord> sliceRecords(clips.size());
+            for (size_t i = 0; i < clips.size(); ++i) {
+                sliceRecords[i] = { records[i], clips[i].offset, clips[i].length };
+            }
+            file.write(reinterpret_cast<const char*>(sliceRecords.data()), static_cast<std::streamsize>(sliceRecords.size() * sizeof(SliceRecord)));
+        }
+        else {
+            file.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+        }
+        return static_cast<bool>(file);
+    }
+
+private:
+    static std::vector<AudioClip> loadBinary(const uint8_t* data, size_t size)
+    {
+        uint32_t header[4];
+        uint64_t counts[2];
+        if (size < 32) {
+            throw std::runtime_error("Truncated clip list");
+        }
+        std::memcpy(header, data, sizeof(header));
+        std::memcpy(counts, data + 16, sizeof(counts));
+        if (header[1] < 1 || header[1] > version) {
+            throw std::runtime_error("Unsupported clip list version " + std::to_string(header[1]));
+        }
+        // 各版本的记录依次是 RepeatRecord 的前缀
+        const uint64_t recordSizes[] = { sizeof(Record), sizeof(SliceRecord), sizeof(RepeatRecord) };
+        const uint64_t recordSize = recordSizes[header[1] - 1];
+        const uint64_t numPaths = header[2];
+        const uint64_t numClips = counts[0];
+        const uint64_t pathBytes = counts[1];
+        if (pathBytes > size || numClips > size / recordSize || numPaths > size / sizeof(uint64_t)) {
+            throw std::runtime_error("Truncated clip list");
+        }
+        const uint64_t stringsStart = 32 + (numPaths + 1) * sizeof(uint64_t);
+        const uint64_t recordsStart = stringsStart + (pathBytes + 7) / 8 * 8;
+        if (recordsStart + numClips * recordSize != size) {
+            throw std::runtime_error("Truncated clip list");
+        }
+
+        std::vector<std::string> paths(static_cast<size_t>(numPaths));
+        for (uint64_t p = 0; p < numPaths; ++p) {
+            uint64_t range[2];
+            std::memcpy(range, data + 32 + p * sizeof(uint64_t), sizeof(range));
+            if (range[0] > range[1] || range[1] > pathBytes) {
+                throw std::runtime_error("Corrupt clip list path table");
+            }
+            paths[p].assign(reinterpret_cast<const char*>(data + stringsStart + range[0]), static_cast<size_t>(range[1] - range[0]));
+        }
+
+        std::vector<AudioClip> clips(static_cast<size_t>(numClips));
+        for (uint64_t i = 0; i < numClips; ++i) {
+            RepeatRecord stored = { { {}, 0.0, -1.0 }, 0.0, 1 };
+            std::memcpy(&stored, data + recordsStart + i * recordSize, static_cast<size_t>(recordSize));
+            const Record& record = stored.slice.record;
+            if (record.path >= numPaths) {
+                throw std::runtime_error("Corrupt clip list record " + std::to_string(i));
+            }
+            clips[i].filename = paths[record.path];
+            clips[i].startTime = std::max(record.startTime, 0.0);
+            clips[i].volume = std::max(record.volume, 0.0f);
+            clips[i].offset = std::max(stored.slice.offset, 0.0);
+            clips[i].length = stored.slice.length;
+            clips[i].repeat = std::max<int64_t>(stored.repeat, 1);
+            clips[i].period = std::max(stored.period, 0.0);
+        }
+        return clips;
+    }
+
+    // repeat 大于 1 时 period 必须大于 0（否则各次放置叠在同一处），最后一次放置不能超出 maxStartTime
+    static void validatePlacement(const AudioClip& clip, size_t index)
+    {
+        const std::string name = "Clip " + std::to_string(index + 1) + " (" + clip.filename + "): ";
+        if (!std::isfinite(clip.startTime) || !std::isfinite(clip.period)) {
+            throw std::runtime_error(name + "start time and period must be finite");
+        }
+        if (clip.repeat > 1 && clip.period <= 0.0) {
+            throw std::runtime_error(name + "repeat=" + std::to_string(clip.repeat) + " needs period=<s> greater than 0");
+        }
+        const double lastStart = clip.startTime + static_cast<double>(clip.repeat - 1) * clip.period;
+        if (!(lastStart <= maxStartTime)) {
+            char message[128];
+            std::snprintf(message, sizeof(message), "last placement starts at %.6g s, beyond the %.6g s timeline limit", lastStart, maxStartTime);
+            throw std::runtime_error(name + message);
+        }
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    // 与 std::stod / std::stof 一样接受开头的正号并忽略数字后面多余的字符
+    template <class T>
+    static T parseNumber(std::string_view token)
+    {
+        const char* first = token.data();
+        const char* last = first + token.size();
+        if (first != last && *first == '+') {
+            ++first;
+        }
+        T value = 0;
+        const std::from_chars_result result = std::from_chars(first, last, value);
+        if (result.ec != std::errc()) {
+            throw std::runtime_error("Invalid number: " + std::string(token));
+        }
+        return value;
+    }
+
+    // 片段三个字段后面可选的 key=value 字段，值必须整个是数字。
+    // 只有紧跟在完整的一组三个字段之后才算（见 parseText），名字像 offset=x.wav 的文件照常当作文件名
+    static bool isOption(std::string_view token)
+    {
+        for (const char* key : { "offset=", "length=", "repeat=", "period=" }) {
+            if (token.size() > 7 && token.compare(0, 7, key) == 0) {
+                const char* first = token.data() + 7;
+                const char* last = token.data() + token.size();
+                if (*first == '+') {
+                    ++first;
+                }
+                double value = 0;
+                const std::from_chars_result result = std::from_chars(first, last, value);
+                return result.ec == std::errc() && result.ptr == last;
+            }
+        }
+        return false;
+    }
+
+    static void applyOption(std::string_view token, AudioClip& clip)
+    {
+        const std::string_view value = token.substr(7);
+        switch (token[0]) {
+        case 'o':
+            clip.offset = std::max(parseNumber<double>(value), 0.0);
+            break;
+        case 'l':
+            clip.length = std::max(parseNumber<double>(value), 0.0);
+            break;
+        case 'r':
+            clip.repeat = std::max(parseNumber<int64_t>(value), int64_t(1));
+            break;
+        default:
+            clip.period = std::max(parseNumber<double>(value), 0.0);
+            break;
+        }
+    }
+
+    // 在换行处把文本切成若干块，各块并行切分字段；按前缀和算出每块第一个字段的全局序号，
+    // 再并行转换成片段。一组三个字段可以跨行（和原来按空白切分的行为一致）。
+    // 像可选字段的记号是不是可选字段取决于它前面有多少个字段，各块只记下这些记号，求前缀和时顺序判定；可选字段不参与计数，
+    // 跨块的片段由两个线程分别写不同的成员，不存在数据竞争
+    static std::vector<AudioClip> parseText(const char* text, size_t size, int jobs)
+    {
+        if (size >= 3 && std::memcmp(text, "\xEF\xBB\xBF", 3) == 0) {
+            text += 3;
+            size -= 3;
+        }
+
+        const size_t minChunkSize = 1 << 20;
+        const size_t numChunks = std::clamp<size_t>(size / minChunkSize, 1, static_cast<size_t>(std::max(jobs, 1)) * 4);
+        std::vector<size_t> bounds(1, 0);
+        for (size_t k = 1; k < numChunks; ++k) {
+            size_t pos = std::max(size / numChunks * k, bounds.back());
+            while (pos < size && text[pos] != '\n') {
+                ++pos;
+            }
+            if (pos < size) {
+                bounds.push_back(pos + 1);
+            }
+        }
+        bounds.push_back(size);
+        const size_t chunks = bounds.size() - 1;
+
+        std::unique_ptr<ThreadPool> pool;
+        if (chunks > 1) {
+            pool = std::make_unique<ThreadPool>(std::min<int>(jobs, static_cast<int>(chunks)));
+        }
+        auto forEachChunk = [&](const std::function<void(size_t)>& body) {
+            if (pool) {
+                pool->parallelFor(chunks, body);
+            }
+            else {
+                body(0);
+            }
+        };
+
+        std::vector<std::vector<std::string_view>> tokens(chunks);
+        std::vector<std::vector<size_t>> options(chunks); // 像可选字段的记号在块内的下标，判定之后只留下真正的可选字段
+        forEachChunk([&](size_t c) {
+            const char* p = text + bounds[c];
+            const char* end = text + bounds[c + 1];
+            for (;;) {
+                while (p < end && isSpace(*p)) {
+                    ++p;
+                }
+                if (p == end) {
+                    break;
+                }
+                const char* start = p;
+                while (p < end && !isSpace(*p)) {
+                    ++p;
+                }
+                tokens[c].emplace_back(start, static_cast<size_t>(p - start));
+                if (isOption(tokens[c].back())) {
+                    options[c].push_back(tokens[c].size() - 1);
+                }
+            }
+        });
+
+        std::vector<size_t> firstToken(chunks + 1, 0);
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t accepted = 0;
+            for (size_t t : options[c]) {
+                const size_t index = firstToken[c] + t - accepted;
+                if (index > 0 && index % 3 == 0) {
+                    options[c][accepted++] = t;
+                }
+            }
+            options[c].resize(accepted);
+            firstToken[c + 1] = firstToken[c] + tokens[c].size() - accepted;
+        }
+        if (firstToken[chunks] % 3 != 0) {
+            throw std::runtime_error("Input file must contain groups of 3: <wavfile> <starttime> <volume> [offset=<s>] [length=<s>] [repeat=<n>] [period=<s>]");
+        }
+
+        std::vector<AudioClip> clips(firstToken[chunks] / 3);
+        forEachChunk([&](size_t c) {
+            size_t index = firstToken[c];
+            size_t nextOption = 0;
+            for (size_t t = 0; t < tokens[c].size(); ++t) {
+                const std::string_view token = tokens[c][t];
+                if (nextOption < options[c].size() && options[c][nextOption] == t) {
+                    ++nextOption;
+                    applyOption(token, clips[index / 3 - 1]);
+                    continue;
+                }
+                AudioClip& clip = clips[index / 3];
+                switch (index++ % 3) {
+                case 0:
+                    clip.filename.assign(token.data(), token.size());
+                    break;
+                case 1:
+                    clip.startTime = std::max(parseNumber<double>(token), 0.0);
+                    break;
+                default:
+                    clip.volume = std::max(parseNumber<float>(token), 0.0f);
+                    break;
+                }
+            }
+        });
+        return clips;
+    }
+};
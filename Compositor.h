@@ -0,0 +1,1156 @@
+﻿#pragma once
+#include "AudioFile.h"
+#include "ThreadPool.h"
+#include "Resampler.h"
+#include "MixKernels.h"
+#include "ClipList.h"
+#include "Profiler.h"
+#include "Prefetch.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// 渲染引擎：音源的加载与缓存、片段在时间线上的位置、分块并行混音，
+// 以及可以嵌入其他程序的 Compositor。命令行工具的各种渲染模式都建立在这些组件之上
+
+// 渲染参数（来自命令行，嵌入时由调用方填写）
+struct RenderOptions {
+    int sampleRate = 44100;
+    std::string outputFile = "result.wav";
+    bool streamMode = false;
+    int blockSize = 65536;
+    bool dither = false; // 输出 16 位时加 TPDF 抖动
+    int jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); // 解码、重采样的线程数
+    ResampleQuality resampleQuality = ResampleQuality::Medium;
+    std::string cacheDir; // 非空时把解码、重采样的结果缓存到这个目录
+    bool incremental = false; // 只重新混音输入有变化的块
+    bool dryRun = false;      // 只读文件头，报告时长和内存
+    bool limiter = false;     // 用前瞻限幅器代替全局归一化，逐块写出
+    std::string saveClipList; // 非空时把片段列表转存为二进制格式后退出
+    bool profile = false;     // 结束时输出各阶段耗时和计数器
+    std::string profileTrace; // 非空时另外写出 Chrome trace
+    bool verbose = true;      // 输出加载、归一化等过程信息，嵌入时可以关掉
+    std::string serveSocket;  // 非空时作为常驻进程在这个 Unix 域套接字上接受任务
+    int64_t cacheBudget = int64_t(2048) << 20; // 常驻进程缓存音源的内存上限（字节）
+    int maxJobs = 4;          // 常驻进程同时处理的任务数上限
+    int prefetch = 32;        // 提前读进页缓存的片段数，0 表示不预读
+};
+
+// 只读音源的文件头（源文件本身的格式，不考虑截取和重采样）。fileData 不为空时读的是这段内存中的文件
+inline bool probeSource(const AudioClip& clip, AudioFileInfo& info, const std::vector<uint8_t>* fileData = nullptr)
+{
+    if (fileData == nullptr)
+    {
+        return AudioFile<float>::probe(clip.filename, info);
+    }
+    AudioFileReader<float> reader;
+    if (!reader.openFromMemory(fileData->data(), fileData->size()))
+    {
+        return false;
+    }
+    info.format = reader.getAudioFileFormat();
+    info.sampleRate = reader.getSampleRate();
+    info.numChannels = reader.getNumChannels();
+    info.bitDepth = reader.getBitDepth();
+    info.numSamplesPerChannel = reader.getNumSamplesPerChannel();
+    return true;
+}
+
+// 加载片段并重采样到目标采样率；截取了一段的片段只解码这一段。fileData 不为空时从这段内存中的文件解码，不读磁盘
+inline bool loadClipAudio(const AudioClip& clip, const RenderOptions& options, AudioFile<float>& audio,
+    const std::vector<uint8_t>* fileData = nullptr)
+{
+    const int sampleRate = options.sampleRate;
+    {
+        // 文件是映射进内存边解码边读取的，读盘时间也算在这里
+        ProfileScope scope("load");
+        bool loaded = false;
+        if (clip.isSlice())
+        {
+            AudioFileInfo info;
+            int64_t startSample = 0;
+            int64_t numSamples = 0;
+            loaded = probeSource(clip, info, fileData);
+            if (loaded)
+            {
+                clipSourceRange(clip, info.sampleRate, info.numSamplesPerChannel, startSample, numSamples);
+                loaded = fileData != nullptr ? audio.loadRangeFromMemory(*fileData, startSample, numSamples)
+                                             : audio.loadRange(clip.filename, startSample, numSamples);
+            }
+        }
+        else
+        {
+            loaded = fileData != nullptr ? audio.loadFromMemory(*fileData) : audio.load(clip.filename);
+        }
+        if (!loaded)
+        {
+            std::printf("Failed to load %s\n", clip.filename.c_str());
+            return false;
+        }
+        const int64_t samples = audio.getNumSamplesPerChannel() * audio.getNumChannels();
+        Profiler::count("samples decoded", samples);
+        Profiler::count("bytes read", samples * (audio.getBitDepth() / 8));
+    }
+    const int originalSampleRate = audio.getSampleRate();
+
+    if (originalSampleRate != sampleRate)
+    {
+        ProfileScope scope("resample");
+        Profiler::count("samples resampled", audio.getNumSamplesPerChannel() * audio.getNumChannels());
+        if (options.verbose)
+        {
+            std::printf("resampling.\n");
+        }
+        for (int ch = 0; ch < audio.getNumChannels(); ++ch)
+        {
+            resampleAudio(audio.samples[ch], originalSampleRate, sampleRate, options.resampleQuality);
+        }
+        audio.setSampleRate(sampleRate); // 更新元数据
+    }
+    return true;
+}
+
+// 每次处理 8 个字节的 64 位哈希，末尾用 murmur3 的 fmix64 打散
+inline uint64_t hashBytes(const void* bytes, size_t size, uint64_t seed = 0x9E3779B97F4A7C15ull)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(bytes);
+    uint64_t h = seed ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        h ^= word * 0x87C37B91114253D5ull;
+        h = ((h << 31) | (h >> 33)) * 0x4CF5AD432745937Full;
+    }
+    for (; i < size; ++i)
+    {
+        h = (h ^ data[i]) * 0x100000001B3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// 解码、重采样好的音源（按声道分开的 float 采样）。数据来自刚解码的 AudioFile，
+// 或者映射进内存的磁盘缓存文件；被多个片段引用时共享同一份只读数据
+struct DecodedSource {
+    AudioFile<float> audio;
+    MappedFile mapped;
+    std::vector<const float*> channels;
+    uint32_t sampleRate = 0;
+    int64_t numSamples = 0;
+
+    int getNumChannels() const { return static_cast<int>(channels.size()); }
+    int64_t getNumSamplesPerChannel() const { return numSamples; }
+    double getLengthInSeconds() const { return (double)numSamples / (double)sampleRate; }
+};
+using SharedAudio = std::shared_ptr<const DecodedSource>;
+
+// 内存中的音源文件（完整的 wav/aiff 文件内容）
+using SourceData = std::shared_ptr<const std::vector<uint8_t>>;
+
+// 磁盘上的音源缓存（--cache-dir）。文件名由源文件内容的哈希、目标采样率和重采样质量组成，
+// 内容是 32 字节的文件头加上按声道依次存放的 float 采样，下次运行时直接映射使用，跳过解码和重采样
+struct SourceCacheFile {
+    static constexpr uint32_t version = 1;
+    static constexpr size_t headerSize = 32;
+
+    // 缓存文件路径；源文件无法读取时返回空串
+    static std::string pathFor(const std::string& cacheDir, const std::string& sourcePath, int sampleRate, ResampleQuality quality)
+    {
+        MappedFile source;
+        if (!source.open(sourcePath))
+        {
+            return std::string();
+        }
+        return pathFor(cacheDir, source.data(), source.size(), sampleRate, quality);
+    }
+
+    // 内存中的源文件按同样的规则命名，内容相同的文件与内存数据共用一份缓存
+    static std::string pathFor(const std::string& cacheDir, const uint8_t* data, size_t size, int sampleRate, ResampleQuality quality)
+    {
+        const char* qualityNames[] = { "fast", "medium", "best" };
+        char name[96];
+        std::snprintf(name, sizeof(name), "%016llx_%d_%s.f32", static_cast<unsigned long long>(hashBytes(data, size)),
+            sampleRate, qualityNames[static_cast<int>(quality)]);
+        return (std::filesystem::path(cacheDir) / name).string();
+    }
+
+    // 截取了一段的片段单独缓存，文件名后面加上截取范围
+    static std::string slicePathFor(const std::string& cachePath, const AudioClip& clip)
+    {
+        char range[64];
+        std::snprintf(range, sizeof(range), "_%.9g_%.9g.f32", clip.offset, clip.length);
+        return cachePath.substr(0, cachePath.size() - 4) + range;
+    }
+
+    static bool load(const std::string& path, uint32_t sampleRate, DecodedSource& source)
+    {
+        ProfileScope scope("cache load");
+        if (!source.mapped.open(path) || source.mapped.size() < headerSize)
+        {
+            return false;
+        }
+        const uint8_t* data = source.mapped.data();
+        uint32_t header[4];
+        uint64_t numSamples = 0;
+        std::memcpy(header, data, sizeof(header));
+        std::memcpy(&numSamples, data + 16, sizeof(numSamples));
+        const uint32_t numChannels = header[2];
+        if (std::memcmp(header, "WCSC", 4) != 0 || header[1] != version || header[3] != sampleRate || numChannels == 0
+            || source.mapped.size() != headerSize + static_cast<size_t>(numChannels) * numSamples * sizeof(float))
+        {
+            source.mapped.close();
+            return false;
+        }
+        source.sampleRate = sampleRate;
+        source.numSamples = static_cast<int64_t>(numSamples);
+        for (uint32_t ch = 0; ch < numChannels; ++ch)
+        {
+            source.channels.push_back(reinterpret_cast<const float*>(data + headerSize) + static_cast<size_t>(ch) * numSamples);
+        }
+        Profiler::count("bytes read", static_cast<int64_t>(source.mapped.size()));
+        return true;
+    }
+
+    // 先写临时文件再改名，其他进程不会读到写了一半的缓存
+    static bool store(const std::string& path, const DecodedSource& source)
+    {
+        ProfileScope scope("cache store");
+        std::ostringstream suffix;
+        suffix << ".tmp" << std::this_thread::get_id() << "_" << static_cast<const void*>(&source);
+        const std::string tempPath = path + suffix.str();
+        {
+            std::ofstream file(tempPath, std::ios::binary);
+            uint32_t header[4] = { 0, version, static_cast<uint32_t>(source.getNumChannels()), source.sampleRate };
+            std::memcpy(header, "WCSC", 4);
+            const uint64_t numSamples = static_cast<uint64_t>(source.numSamples);
+            const uint64_t reserved = 0;
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(&numSamples), sizeof(numSamples));
+            file.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+            for (const float* channel : source.channels)
+            {
+                file.write(reinterpret_cast<const char*>(channel), static_cast<std::streamsize>(source.numSamples * sizeof(float)));
+            }
+            if (!file)
+            {
+                file.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// 加载音源：配置了 --cache-dir 时先查磁盘缓存，未命中再解码、重采样并写回缓存。加载失败时返回空指针。
+// fileData 不为空时音源是这段内存中的文件，clip.filename 只是它的名字
+inline SharedAudio loadSource(const AudioClip& clip, const RenderOptions& options, const std::vector<uint8_t>* fileData = nullptr)
+{
+    std::string cachePath;
+    if (!options.cacheDir.empty())
+    {
+        cachePath = fileData != nullptr
+            ? SourceCacheFile::pathFor(options.cacheDir, fileData->data(), fileData->size(), options.sampleRate, options.resampleQuality)
+            : SourceCacheFile::pathFor(options.cacheDir, clip.filename, options.sampleRate, options.resampleQuality);
+        if (!cachePath.empty() && clip.isSlice())
+        {
+            cachePath = SourceCacheFile::slicePathFor(cachePath, clip);
+        }
+        auto cached = std::make_shared<DecodedSource>();
+        if (!cachePath.empty() && SourceCacheFile::load(cachePath, static_cast<uint32_t>(options.sampleRate), *cached))
+        {
+            return cached;
+        }
+    }
+
+    auto source = std::make_shared<DecodedSource>();
+    if (!loadClipAudio(clip, options, source->audio, fileData))
+    {
+        return nullptr;
+    }
+    source->sampleRate = source->audio.getSampleRate();
+    source->numSamples = source->audio.getNumSamplesPerChannel();
+    for (const std::vector<float>& channel : source->audio.samples)
+    {
+        source->channels.push_back(channel.data());
+    }
+    if (!cachePath.empty() && !SourceCacheFile::store(cachePath, *source))
+    {
+        std::printf("Failed to write cache %s\n", cachePath.c_str());
+    }
+    return source;
+}
+
+// 进程内的音源缓存：以 路径 + 修改时间 + 目标采样率 + 重采样质量 + 截取范围 为键，同一个文件只加载一次。
+// 多个线程同时请求同一个音源时只有第一个线程加载，其余线程等待它的结果。加载失败时返回空指针（或抛出加载时的异常），
+// 失败的条目不留在缓存里，文件修好或补上之后下一次请求会重新加载。
+// 内存中的音源用数据的地址代替修改时间，条目持有这份数据，地址在条目淘汰之前不会被别的数据重用。
+// budgetBytes 大于 0 时（常驻进程）只保留最近用过、总大小不超过预算的音源；被淘汰的音源仍被引用时照常可用
+class SourceCache {
+public:
+    explicit SourceCache(int64_t budgetBytes = 0)
+        : budgetBytes(budgetBytes)
+    {
+    }
+
+    SharedAudio get(const AudioClip& clip, const RenderOptions& options, const SourceData& fileData = nullptr)
+    {
+        std::error_code error;
+        int64_t stamp = 0;
+        if (fileData)
+        {
+            stamp = static_cast<int64_t>(reinterpret_cast<uintptr_t>(fileData.get()));
+        }
+        else
+        {
+            const auto modified = std::filesystem::last_write_time(clip.filename, error);
+            stamp = error ? 0 : static_cast<int64_t>(modified.time_since_epoch().count());
+        }
+        const Key key(clip.filename, stamp, options.sampleRate, static_cast<int>(options.resampleQuality), clip.offset, clip.length);
+
+        std::promise<SharedAudio> promise;
+        std::shared_future<SharedAudio> result;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = entries.find(key);
+            if (found == entries.end())
+            {
+                result = promise.get_future().share();
+                recent.push_front(key);
+                entries.emplace(key, Entry{ result, nullptr, fileData, recent.begin() });
+                owner = true;
+            }
+            else
+            {
+                recent.splice(recent.begin(), recent, found->second.position);
+                Profiler::count("source cache hits", 1);
+                if (found->second.ready)
+                {
+                    return found->second.audio;
+                }
+                result = found->second.result;
+            }
+        }
+        if (owner)
+        {
+            SharedAudio loaded;
+            std::exception_ptr error;
+            try
+            {
+                loaded = loadSource(clip, options, fileData.get());
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = entries.find(key);
+                if (loaded)
+                {
+                    // 加载完的条目直接持有音源，不再经过 future，淘汰时按引用计数判断是否正在使用
+                    Entry& entry = found->second;
+                    entry.ready = true;
+                    entry.audio = loaded;
+                    entry.result = std::shared_future<SharedAudio>();
+                    entry.bytes = loaded->getNumChannels() * loaded->getNumSamplesPerChannel() * static_cast<int64_t>(sizeof(float));
+                    residentBytes += entry.bytes;
+                    evict(key);
+                }
+                else
+                {
+                    recent.erase(found->second.position);
+                    entries.erase(found);
+                }
+            }
+            // 正在等待的线程持有 future，条目删掉之后照样能拿到结果
+            if (error)
+            {
+                promise.set_exception(error);
+            }
+            else
+            {
+                promise.set_value(loaded);
+            }
+        }
+        return result.get();
+    }
+
+    // 缓存中音源的总大小（字节）
+    int64_t getResidentBytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return residentBytes;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+private:
+    using Key = std::tuple<std::string, int64_t, int, int, double, double>;
+
+    struct Entry {
+        std::shared_future<SharedAudio> result; // 加载期间其他线程在这里等待结果
+        SharedAudio audio;                      // 加载完成后的音源
+        SourceData fileData;
+        std::list<Key>::iterator position;
+        int64_t bytes = 0;
+        bool ready = false;
+    };
+
+    // 从最久没用过的一端淘汰已经加载完的条目，直到总大小回到预算以内。调用时必须持有 mutex。
+    // 刚加载的 keep 和正被渲染引用的音源不淘汰（淘汰它们省不下内存，只会让下一次使用重新解码），
+    // 所以单个音源比预算还大时缓存可以暂时超出预算。还在等待 future 的线程也算作引用
+    void evict(const Key& keep)
+    {
+        if (budgetBytes <= 0)
+        {
+            return;
+        }
+        for (auto key = recent.end(); residentBytes > budgetBytes && key != recent.begin();)
+        {
+            --key;
+            auto found = entries.find(*key);
+            if (!found->second.ready || *key == keep || found->second.audio.use_count() > 1)
+            {
+                continue;
+            }
+            residentBytes -= found->second.bytes;
+            entries.erase(found);
+            key = recent.erase(key);
+            Profiler::count("source cache evictions", 1);
+        }
+    }
+
+    int64_t budgetBytes = 0;
+    int64_t residentBytes = 0;
+    mutable std::mutex mutex;
+    std::list<Key> recent; // 最近用过的在前
+    std::map<Key, Entry> entries;
+};
+
+// 流式渲染中正在发声的片段
+struct ActiveClip {
+    size_t index = 0; // 在输入列表中的序号，按它排序以保证混音的累加顺序与整段渲染一致
+    AudioFileReader<float> reader; // 采样率与目标一致时，直接从映射的文件中按窗口解码
+    SharedAudio audio;             // 需要重采样时整段解码
+    bool decodeByBlock = false;
+    int numChannels = 0;
+    int64_t sourceStart = 0; // 按窗口解码时截取范围在源文件中的起点
+    int64_t numSamples = 0;  // 片段（截取、重采样之后）的采样数
+    int64_t repeat = 1;         // 重复放置的次数，各次读的都是同一份音源
+    double position = 0.0;      // 第一次放置在时间线上的位置（采样，未取整）
+    double periodSamples = 0.0; // 相邻两次放置的间隔（采样）
+    int64_t startSample = 0;    // 所有放置合起来占据的范围
+    int64_t endSample = 0;
+};
+
+// 打开片段：采样率一致时只解析文件头，否则整段（截取的那一段）解码并重采样
+inline bool openActiveClip(const AudioClip& clip, const RenderOptions& options, ActiveClip& active, double& lengthInSeconds)
+{
+    if (!active.reader.open(clip.filename))
+    {
+        std::printf("Failed to load %s\n", clip.filename.c_str());
+        return false;
+    }
+    if (static_cast<int>(active.reader.getSampleRate()) == options.sampleRate)
+    {
+        active.decodeByBlock = true;
+        active.numChannels = active.reader.getNumChannels();
+        clipSourceRange(clip, active.reader.getSampleRate(), active.reader.getNumSamplesPerChannel(), active.sourceStart, active.numSamples);
+        lengthInSeconds = static_cast<double>(active.numSamples) / options.sampleRate;
+        return true;
+    }
+    active.reader.close();
+
+    active.audio = loadSource(clip, options);
+    if (!active.audio)
+    {
+        return false;
+    }
+    active.numChannels = active.audio->getNumChannels();
+    active.numSamples = active.audio->getNumSamplesPerChannel();
+    lengthInSeconds = active.audio->getLengthInSeconds();
+    return true;
+}
+
+// 片段在时间线上的起始采样
+inline int64_t clipStartSample(const AudioClip& clip, int sampleRate)
+{
+    return static_cast<int64_t>(std::llround(clip.startTime * sampleRate));
+}
+
+// 第 k 次放置在时间线上的位置（采样，未取整）
+inline double placementPosition(double position, double periodSamples, int64_t k)
+{
+    return k == 0 ? position : position + static_cast<double>(k) * periodSamples;
+}
+
+// 片段在时间线上占据的采样范围 [startSample, endSample)，重复放置时是从第一次开始到最后一次结束。
+// 结束位置 floor((startTime + 时长) * sampleRate) 化简为 floor(startTime * sampleRate) + numSamples，
+// 全部用整数采样数计算，时间线再长也不会因为浮点相加而漂移
+inline void clipSampleRange(const AudioClip& clip, int64_t numSamples, int sampleRate, int64_t& startSample, int64_t& endSample)
+{
+    const double position = clip.startTime * sampleRate;
+    startSample = static_cast<int64_t>(std::llround(position));
+    endSample = static_cast<int64_t>(std::floor(placementPosition(position, clip.period * sampleRate, clip.repeat - 1))) + numSamples;
+}
+
+// 按 active.numSamples 把打开的片段放到时间线上
+inline void placeActiveClip(const AudioClip& clip, int sampleRate, ActiveClip& active)
+{
+    active.repeat = clip.repeat;
+    active.position = clip.startTime * sampleRate;
+    active.periodSamples = clip.period * sampleRate;
+    clipSampleRange(clip, active.numSamples, sampleRate, active.startSample, active.endSample);
+}
+
+// 只读文件头，得到片段截取、重采样到目标采样率之后的格式（采样数、时长与真正解码、重采样之后一致）。
+// fileData 不为空时读的是这段内存中的文件
+inline bool probeClip(const AudioClip& clip, int sampleRate, AudioFileInfo& info, const std::vector<uint8_t>* fileData = nullptr)
+{
+    ProfileScope scope("probe");
+    if (!probeSource(clip, info, fileData))
+    {
+        return false;
+    }
+    if (clip.isSlice())
+    {
+        int64_t startSample = 0;
+        clipSourceRange(clip, info.sampleRate, info.numSamplesPerChannel, startSample, info.numSamplesPerChannel);
+    }
+    if (static_cast<int>(info.sampleRate) != sampleRate)
+    {
+        info.numSamplesPerChannel = static_cast<int64_t>(std::llround(static_cast<double>(info.numSamplesPerChannel) * sampleRate / info.sampleRate));
+        info.sampleRate = static_cast<uint32_t>(sampleRate);
+    }
+    return true;
+}
+
+// 只读文件头，算出片段在时间线上的采样范围
+inline bool probeClipRange(const AudioClip& clip, int sampleRate, int64_t& startSample, int64_t& endSample,
+    const std::vector<uint8_t>* fileData = nullptr)
+{
+    AudioFileInfo info;
+    if (!probeClip(clip, sampleRate, info, fileData))
+    {
+        return false;
+    }
+    clipSampleRange(clip, info.numSamplesPerChannel, sampleRate, startSample, endSample);
+    return true;
+}
+
+// 把一段采样按音量叠加到输出缓冲区，单声道同时叠加到左右声道
+inline void mixSpan(const float* ch0, const float* ch1, bool mono, float volume, float* left, float* right, int64_t count)
+{
+    if (mono)
+    {
+        MixKernel<true>::process(ch0, nullptr, volume, left, right, count);
+    }
+    else
+    {
+        MixKernel<false>::process(ch0, ch1, volume, left, right, count);
+    }
+}
+
+// 把片段的一次放置 [startSample, endSample) 与窗口 [blockStart, blockStart + blockSize) 重叠的部分叠加到窗口缓冲区，
+// 没有重叠时返回 false
+inline bool mixPlacementIntoBlock(const ActiveClip& active, int64_t startSample, int64_t endSample, float volume, float* left, float* right,
+    int64_t blockStart, int blockSize, std::vector<std::vector<float>>& scratch)
+{
+    const int64_t from = std::max(startSample, blockStart);
+    const int64_t to = std::min(endSample, blockStart + blockSize);
+    if (from >= to)
+    {
+        return false;
+    }
+    const int64_t offset = from - startSample;
+    const bool mono = active.numChannels == 1;
+
+    if (active.decodeByBlock)
+    {
+        if (scratch.size() < static_cast<size_t>(active.numChannels))
+        {
+            scratch.resize(active.numChannels, std::vector<float>(blockSize));
+        }
+        std::vector<float*> channels;
+        for (int ch = 0; ch < active.numChannels; ++ch)
+        {
+            channels.push_back(scratch[ch].data());
+        }
+        ProfileScope scope("decode block");
+        const int64_t count = active.reader.read(active.sourceStart + offset, to - from, channels.data());
+        Profiler::count("samples decoded", count * active.numChannels);
+        Profiler::count("bytes read", count * active.numChannels * (active.reader.getBitDepth() / 8));
+        mixSpan(channels[0], mono ? nullptr : channels[1], mono, volume, left + (from - blockStart), right + (from - blockStart), count);
+    }
+    else
+    {
+        const float* ch0 = active.audio->channels[0] + offset;
+        const float* ch1 = mono ? nullptr : active.audio->channels[1] + offset;
+        mixSpan(ch0, ch1, mono, volume, left + (from - blockStart), right + (from - blockStart), to - from);
+    }
+    return true;
+}
+
+// 把片段与窗口重叠的部分叠加到窗口缓冲区。重复放置的片段只按间隔算出可能与窗口重叠的几次，
+// 依次叠加，累加顺序与把每次放置写成单独一行时相同。没有一次放置与窗口重叠时返回 false
+inline bool mixClipIntoBlock(const ActiveClip& active, float volume, float* left, float* right, int64_t blockStart, int blockSize,
+    std::vector<std::vector<float>>& scratch)
+{
+    const int64_t blockEnd = blockStart + blockSize;
+    if (active.startSample >= blockEnd || active.endSample <= blockStart)
+    {
+        return false;
+    }
+    if (active.repeat <= 1)
+    {
+        return mixPlacementIntoBlock(active, active.startSample, active.endSample, volume, left, right, blockStart, blockSize, scratch);
+    }
+    int64_t first = 0;
+    int64_t last = active.repeat - 1;
+    if (active.periodSamples > 0.0)
+    {
+        // 多算一次放置，抵消取整的误差，不重叠的放置在下面直接跳过
+        const double lastPlacement = static_cast<double>(last);
+        first = static_cast<int64_t>(std::clamp(std::floor((blockStart - active.numSamples - active.position) / active.periodSamples) - 1.0, 0.0, lastPlacement));
+        last = static_cast<int64_t>(std::clamp(std::ceil((blockEnd - active.position) / active.periodSamples) + 1.0, 0.0, lastPlacement));
+    }
+    bool mixed = false;
+    for (int64_t k = first; k <= last; ++k)
+    {
+        const double position = placementPosition(active.position, active.periodSamples, k);
+        const int64_t startSample = static_cast<int64_t>(std::llround(position));
+        const int64_t endSample = static_cast<int64_t>(std::floor(position)) + active.numSamples;
+        mixed = mixPlacementIntoBlock(active, startSample, endSample, volume, left, right, blockStart, blockSize, scratch) || mixed;
+    }
+    return mixed;
+}
+
+// 并行混音的分块大小（采样数）
+inline constexpr int64_t mixTileSize = 16384;
+
+// 时间线上一个块混音之后的峰值和最后一个非零采样（不存在时为 -1）
+struct TileStats {
+    float peak = 0.0f;
+    int64_t lastNonZero = -1;
+};
+
+// 按时间分块并行混音：把 [rangeStart, rangeEnd) 切成固定大小的块，每个线程只写自己负责的块，
+// 不需要锁或原子操作；块内每个采样仍按 active 的顺序累加，结果与串行混音逐位一致。
+// 先按各片段的 [startSample, endSample) 把片段分到它覆盖的块（保持 active 的顺序），只处理有片段的块：
+// 输入顺序的片段开始时间是乱的，一批片段的总跨度可能覆盖整条时间线，实际写到的却只有其中几块。
+// 传入 stats 时 rangeStart 必须是 mixTileSize 的倍数，真正写过的块混完趁数据还在缓存里更新 stats[块序号]
+inline void mixClipsTiled(ThreadPool& pool, const std::vector<ActiveClip>& active, const std::vector<AudioClip>& clips,
+    float* left, float* right, int64_t rangeStart, int64_t rangeEnd, std::vector<TileStats>* stats = nullptr)
+{
+    const int64_t tileSize = mixTileSize;
+    if (active.empty() || rangeEnd <= rangeStart)
+    {
+        return;
+    }
+    assert(stats == nullptr || rangeStart % tileSize == 0);
+    const size_t numTiles = static_cast<size_t>((rangeEnd - rangeStart + tileSize - 1) / tileSize);
+
+    // 每块的片段列表，压缩存放：块 t 的片段是 tileClips[tileOffsets[t], tileOffsets[t + 1])
+    std::vector<size_t> tileOffsets(numTiles + 1, 0);
+    auto forEachCoveredTile = [&](const ActiveClip& clipState, auto&& visit) {
+        const int64_t from = std::max(clipState.startSample, rangeStart);
+        const int64_t to = std::min(clipState.endSample, rangeEnd);
+        if (from < to)
+        {
+            for (size_t tile = static_cast<size_t>((from - rangeStart) / tileSize); tile <= static_cast<size_t>((to - 1 - rangeStart) / tileSize); ++tile)
+            {
+                visit(tile);
+            }
+        }
+    };
+    for (const ActiveClip& clipState : active)
+    {
+        forEachCoveredTile(clipState, [&](size_t tile) { ++tileOffsets[tile + 1]; });
+    }
+    std::vector<size_t> touchedTiles;
+    for (size_t tile = 0; tile < numTiles; ++tile)
+    {
+        if (tileOffsets[tile + 1] != 0)
+        {
+            touchedTiles.push_back(tile);
+        }
+        tileOffsets[tile + 1] += tileOffsets[tile];
+    }
+    std::vector<size_t> tileClips(tileOffsets[numTiles]);
+    std::vector<size_t> nextSlot(tileOffsets.begin(), tileOffsets.end() - 1);
+    for (size_t i = 0; i < active.size(); ++i)
+    {
+        forEachCoveredTile(active[i], [&](size_t tile) { tileClips[nextSlot[tile]++] = i; });
+    }
+
+    pool.parallelFor(touchedTiles.size(), [&](size_t touched) {
+        ProfileScope scope("mix tile");
+        const size_t tile = touchedTiles[touched];
+        const int64_t tileStart = rangeStart + static_cast<int64_t>(tile) * tileSize;
+        const int tileLength = static_cast<int>(std::min(tileSize, rangeEnd - tileStart));
+        float* tileLeft = left + (tileStart - rangeStart);
+        float* tileRight = right + (tileStart - rangeStart);
+        std::vector<std::vector<float>> scratch;
+        bool mixed = false;
+        for (size_t slot = tileOffsets[tile]; slot < tileOffsets[tile + 1]; ++slot)
+        {
+            const ActiveClip& clipState = active[tileClips[slot]];
+            mixed = mixClipIntoBlock(clipState, clips[clipState.index].volume, tileLeft, tileRight, tileStart, tileLength, scratch) || mixed;
+        }
+        // 重复放置的片段在两次放置之间的空隙里什么也没写，这些块的统计保持不变
+        if (stats != nullptr && mixed)
+        {
+            TileStats& tileStats = (*stats)[static_cast<size_t>(tileStart / tileSize)];
+            tileStats.peak = peakAbs(tileLeft, tileRight, tileLength);
+            tileStats.lastNonZero = -1;
+            for (int i = tileLength - 1; i >= 0; --i)
+            {
+                if (tileLeft[i] != 0 || tileRight[i] != 0)
+                {
+                    tileStats.lastNonZero = tileStart + i;
+                    break;
+                }
+            }
+        }
+    });
+}
+
+// 扩大时间线缓冲区，保留已有的混音结果，新增部分清零
+inline void resizeAudioBuffer(std::unique_ptr<float[]>& buffer1, std::unique_ptr<float[]>& buffer2, int64_t& bufferSize, const int64_t& newBufferSize)
+{
+    ProfileScope scope("resize buffer", true);
+    std::printf("Resizing...\n");
+
+    if (bufferSize > newBufferSize)
+    {
+        std::cerr << "Error: Current size (" << bufferSize
+            << ") is larger than new size (" << newBufferSize << ")\n";
+        return;
+    }
+
+    Profiler::count("reallocations", 1);
+    Profiler::count("bytes copied", bufferSize * 2 * static_cast<int64_t>(sizeof(float)));
+
+    // 分配新缓冲区
+    std::unique_ptr<float[]> newBuffer1(new float[newBufferSize]);
+    std::unique_ptr<float[]> newBuffer2(new float[newBufferSize]);
+
+    // 复制旧数据
+    std::memcpy(newBuffer1.get(), buffer1.get(), bufferSize * sizeof(float));
+    std::memcpy(newBuffer2.get(), buffer2.get(), bufferSize * sizeof(float));
+
+    // 将新增部分清零
+    std::memset(newBuffer1.get() + bufferSize, 0, (newBufferSize - bufferSize) * sizeof(float));
+    std::memset(newBuffer2.get() + bufferSize, 0, (newBufferSize - bufferSize) * sizeof(float));
+
+    // 换成新缓冲区（通过引用，外部也会更新），旧缓冲区随之释放
+    buffer1 = std::move(newBuffer1);
+    buffer2 = std::move(newBuffer2);
+
+    // 更新大小
+    bufferSize = newBufferSize;
+
+}
+
+// 渲染结果的去向。begin 给出格式和总长度（末尾静音已裁掉），之后按时间顺序多次 write 归一化之后的采样，
+// 最后调用 end（前面失败了也会调用）。任何一步返回 false 渲染都算失败
+class CompositorSink {
+public:
+    virtual ~CompositorSink() = default;
+    virtual bool begin(int sampleRate, int numChannels, int64_t numSamples) = 0;
+    virtual bool write(const float* const* channels, int numSamples) = 0;
+    virtual bool end() = 0;
+};
+
+// 分块编码写出 16 位 wav，超过 4 GB 时自动写成 RF64
+class WavFileSink : public CompositorSink {
+public:
+    WavFileSink(const std::string& path, bool dither)
+        : path(path)
+    {
+        writer.setDither(dither);
+    }
+
+    bool begin(int sampleRate, int numChannels, int64_t totalSamples) override
+    {
+        numSamples = totalSamples;
+        return writer.open(path, static_cast<uint32_t>(sampleRate), numChannels, 16);
+    }
+
+    bool write(const float* const* channels, int count) override
+    {
+        return writer.write(channels, count);
+    }
+
+    bool end() override
+    {
+        return writer.close();
+    }
+
+    int64_t getNumSamples() const { return numSamples; }
+
+private:
+    std::string path;
+    AudioFileWriter<float> writer;
+    int64_t numSamples = 0;
+};
+
+// 把结果放进调用方的 AudioFile，按声道分开的 float 采样
+class AudioBufferSink : public CompositorSink {
+public:
+    explicit AudioBufferSink(AudioFile<float>& audio)
+        : audio(audio)
+    {
+    }
+
+    bool begin(int sampleRate, int numChannels, int64_t numSamples) override
+    {
+        audio.setSampleRate(static_cast<uint32_t>(sampleRate));
+        audio.setAudioBufferSize(numChannels, numSamples);
+        position = 0;
+        return true;
+    }
+
+    bool write(const float* const* channels, int count) override
+    {
+        if (position + count > audio.getNumSamplesPerChannel())
+        {
+            return false;
+        }
+        for (int ch = 0; ch < audio.getNumChannels(); ++ch)
+        {
+            std::copy(channels[ch], channels[ch] + count, audio.samples[ch].begin() + position);
+        }
+        position += count;
+        return true;
+    }
+
+    bool end() override
+    {
+        return position == audio.getNumSamplesPerChannel();
+    }
+
+private:
+    AudioFile<float>& audio;
+    int64_t position = 0;
+};
+
+// 可嵌入的合成器：在进程内完成与命令行默认模式相同的整段渲染，不需要启动进程，也不经过临时文件。
+// 片段的 filename 可以是文件路径，也可以是用 addSource 注册的名字，对应一段内存中的 wav/aiff 文件。
+// 参数在构造时确定；混音缓冲区属于单次 render，线程池和音源缓存默认也是，同一个 Compositor 可以在多个线程中同时 render
+class Compositor {
+public:
+    explicit Compositor(const RenderOptions& options = RenderOptions())
+        : options(options)
+    {
+    }
+
+    // 使用调用方的线程池和音源缓存，让多个 Compositor 的渲染共用线程和已经解码的音源。两者都必须比 Compositor 活得久
+    Compositor(const RenderOptions& options, ThreadPool& pool, SourceCache& sources)
+        : options(options), sharedPool(&pool), sharedSources(&sources)
+    {
+    }
+
+    const RenderOptions& getOptions() const { return options; }
+
+    // 注册内存中的音源（完整的 wav/aiff 文件内容），之后 filename 为 name 的片段都从这里解码。
+    // 正在进行的 render 继续使用它开始时的数据
+    void addSource(const std::string& name, std::vector<uint8_t> fileData)
+    {
+        auto data = std::make_shared<const std::vector<uint8_t>>(std::move(fileData));
+        std::lock_guard<std::mutex> lock(mutex);
+        memorySources[name] = std::move(data);
+    }
+
+    void removeSource(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        memorySources.erase(name);
+    }
+
+    // 混音、裁掉末尾静音并归一化，结果交给 sink。加载失败的片段会被跳过
+    bool render(const std::vector<AudioClip>& clips, CompositorSink& sink) const
+    {
+        const int sampleRate = options.sampleRate;
+        const bool verbose = options.verbose;
+
+        // 开始时取一次内存音源的快照，渲染期间 addSource / removeSource 不影响这次的结果
+        std::vector<SourceData> clipData;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!memorySources.empty())
+            {
+                clipData.resize(clips.size());
+                for (size_t i = 0; i < clips.size(); ++i)
+                {
+                    auto found = memorySources.find(clips[i].filename);
+                    if (found != memorySources.end())
+                    {
+                        clipData[i] = found->second;
+                    }
+                }
+            }
+        }
+        auto fileDataFor = [&clipData](size_t i) -> const std::vector<uint8_t>* {
+            return clipData.empty() ? nullptr : clipData[i].get();
+        };
+
+        if (verbose)
+        {
+            std::cout << "Loading and resampling audio files...\n";
+        }
+        int64_t maxDuration = 0;
+        for (const AudioClip& clip : clips)
+        {
+            maxDuration = std::max(maxDuration, static_cast<int64_t>(clip.startTime));
+        }
+        std::unique_ptr<ThreadPool> ownPool;
+        if (sharedPool == nullptr)
+        {
+            ownPool = std::make_unique<ThreadPool>(options.jobs);
+        }
+        ThreadPool& pool = sharedPool != nullptr ? *sharedPool : *ownPool;
+
+        // 先只读各片段的文件头，算出时间线的准确长度，缓冲区只分配一次
+        std::vector<int64_t> clipEnds(clips.size(), 0);
+        pool.parallelFor(clips.size(), [&](size_t i) {
+            int64_t startSample = 0;
+            probeClipRange(clips[i], sampleRate, startSample, clipEnds[i], fileDataFor(i));
+        });
+        int64_t timelineEnd = maxDuration * sampleRate;
+        for (int64_t end : clipEnds)
+        {
+            timelineEnd = std::max(timelineEnd, end);
+        }
+        int64_t bufferSize = timelineEnd;
+        if (verbose)
+        {
+            std::printf("Timeline buffer %lld(%lld MiB)\n", static_cast<long long>(bufferSize), static_cast<long long>(bufferSize * sizeof(float) * 2 / 1048576));
+        }
+        // 解码失败、sink 出错等异常离开时缓冲区自动释放，嵌入或常驻进程中不会泄漏
+        std::unique_ptr<float[]> buffer1(new float[bufferSize]);
+        std::unique_ptr<float[]> buffer2(new float[bufferSize]);
+        float* buffer[] = { buffer1.get(), buffer2.get() };
+        std::memset(buffer1.get(), 0, bufferSize * sizeof(float));
+        std::memset(buffer2.get(), 0, bufferSize * sizeof(float));
+        // 混音时顺带统计每块的峰值和最后一个非零采样，收尾时不必再来回扫描整条时间线
+        std::vector<TileStats> tileStats(static_cast<size_t>((bufferSize + mixTileSize - 1) / mixTileSize));
+
+        // 后台线程按输入顺序提前解码、重采样后面的片段（最多 4 * 线程数 个），
+        // 每凑够一批就按时间分块并行混音，结果与单线程完全一致
+        const size_t lookahead = static_cast<size_t>(pool.size()) * 4;
+        const size_t batchSize = std::max<size_t>(lookahead / 2, 1);
+        SourceCache ownSources; // 同一个文件被多次引用时（比如鼓点）只加载一次
+        SourceCache& sources = sharedSources != nullptr ? *sharedSources : ownSources;
+        // 解码按输入顺序进行（混音的累加顺序也是它），预读沿同样的顺序走在解码前面
+        std::unique_ptr<Prefetcher> prefetcher;
+        if (options.prefetch > 0)
+        {
+            prefetcher = std::make_unique<Prefetcher>(clips, std::vector<size_t>(), static_cast<size_t>(options.prefetch));
+        }
+        std::deque<std::future<SharedAudio>> pending;
+        size_t submitted = 0;
+        size_t consumed = 0;
+        std::vector<ActiveClip> batch;
+
+        auto submitUpcoming = [&]() {
+            while (submitted < clips.size() && pending.size() < lookahead)
+            {
+                const AudioClip* upcoming = &clips[submitted];
+                SourceData fileData = clipData.empty() ? nullptr : clipData[submitted];
+                ++submitted;
+                pending.push_back(pool.submit([this, upcoming, fileData, &sources] {
+                    return sources.get(*upcoming, options, fileData);
+                }));
+            }
+            if (prefetcher)
+            {
+                prefetcher->advance(submitted);
+            }
+        };
+
+        while (consumed < clips.size())
+        {
+            submitUpcoming();
+            batch.clear();
+            int64_t batchStart = INT64_MAX;
+            int64_t batchEnd = 0;
+            while (!pending.empty() && batch.size() < batchSize)
+            {
+                const AudioClip& clip = clips[consumed];
+                SharedAudio loaded;
+                {
+                    ProfileScope waitScope("wait for decode");
+                    loaded = pending.front().get();
+                }
+                pending.pop_front();
+                ++consumed;
+                if (!loaded)
+                {
+                    continue;
+                }
+                ActiveClip clipState;
+                clipState.index = consumed - 1;
+                clipState.audio = std::move(loaded);
+                clipState.numChannels = clipState.audio->getNumChannels();
+                clipState.numSamples = clipState.audio->getNumSamplesPerChannel();
+                const DecodedSource& audio = *clipState.audio;
+
+                placeActiveClip(clip, sampleRate, clipState);
+                const int64_t endSampleinBuffer = clipState.endSample;
+                if (verbose)
+                {
+                    std::printf("%s\t%.2fs vol:%.2f|%.2fs->%.2fs\n",clip.filename.c_str(), audio.getLengthInSeconds(), clip.volume, clip.startTime, clip.startTime + audio.getLengthInSeconds());
+                }
+                if (endSampleinBuffer > bufferSize)
+                {
+                    int64_t newBufferSize = endSampleinBuffer;
+                    if (verbose)
+                    {
+                        std::printf("Resize buffer to %lld(%lld MiB)\n", static_cast<long long>(newBufferSize), static_cast<long long>(newBufferSize * sizeof(float) * 2 / 1048576));
+                    }
+                    resizeAudioBuffer(buffer1, buffer2, bufferSize, newBufferSize);
+                    buffer[0] = buffer1.get();
+                    buffer[1] = buffer2.get();
+                    tileStats.resize(static_cast<size_t>((bufferSize + mixTileSize - 1) / mixTileSize));
+                }
+                batchStart = std::min(batchStart, clipState.startSample);
+                batchEnd = std::max(batchEnd, clipState.endSample);
+                batch.push_back(std::move(clipState));
+            }
+
+            // 混音的同时让后台线程继续解码下一批
+            submitUpcoming();
+            if (batchStart < batchEnd)
+            {
+                // 扩展到整块，统计的是整块的最终结果
+                const int64_t rangeStart = batchStart / mixTileSize * mixTileSize;
+                const int64_t rangeEnd = std::min(bufferSize, (batchEnd + mixTileSize - 1) / mixTileSize * mixTileSize);
+                mixClipsTiled(pool, batch, clips, buffer[0] + rangeStart, buffer[1] + rangeStart, rangeStart, rangeEnd, &tileStats);
+            }
+        }
+
+        // 裁剪末尾静音 + 归一化：峰值和末尾位置直接取自各块的统计，
+        // 只剩一遍乘增益、交给 sink，增益在缓存里的小块上完成
+        float maxVal = 0.0f;
+        int64_t lastNonZero = -1;
+        for (const TileStats& stats : tileStats)
+        {
+            maxVal = std::max(maxVal, stats.peak);
+            lastNonZero = std::max(lastNonZero, stats.lastNonZero);
+        }
+        bufferSize = lastNonZero + 1;
+        float gain = 1.0f;
+        if (maxVal > 1.0f) {
+            gain = 1.0f / maxVal;
+            if (verbose)
+            {
+                std::cout << "Normalized audio (max = " << maxVal << ") -> gain = " << gain << "\n";
+            }
+        }
+
+        // 直接从混音缓冲区分块交给 sink，不再复制整段数据
+        ProfileScope finalizeScope("finalize", true);
+        bool saved = sink.begin(sampleRate, 2, bufferSize);
+        const int writeBlock = 65536;
+        std::vector<float> scaledLeft(writeBlock), scaledRight(writeBlock);
+        for (int64_t pos = 0; saved && pos < bufferSize; pos += writeBlock)
+        {
+            const int n = static_cast<int>(std::min<int64_t>(writeBlock, bufferSize - pos));
+            const float* channels[] = { buffer[0] + pos, buffer[1] + pos };
+            if (maxVal > 1.0f)
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    scaledLeft[i] = buffer[0][pos + i] * gain;
+                    scaledRight[i] = buffer[1][pos + i] * gain;
+                }
+                channels[0] = scaledLeft.data();
+                channels[1] = scaledRight.data();
+            }
+            saved = sink.write(channels, n);
+        }
+        saved = sink.end() && saved;
+        return saved;
+    }
+
+    // 渲染成 16 位 wav 文件
+    bool renderToFile(const std::vector<AudioClip>& clips, const std::string& path) const
+    {
+        WavFileSink sink(path, options.dither);
+        if (!render(clips, sink))
+        {
+            std::cerr << "Failed to save: " << path << "\n";
+            return false;
+        }
+        if (options.verbose)
+        {
+            std::cout << "Saved to " << path << " ("
+                << sink.getNumSamples() / options.sampleRate << " seconds)\n";
+        }
+        return true;
+    }
+
+    // 渲染到内存中的 float 采样
+    bool renderToBuffer(const std::vector<AudioClip>& clips, AudioFile<float>& audio) const
+    {
+        AudioBufferSink sink(audio);
+        return render(clips, sink);
+    }
+
+    // 渲染成内存中的 16 位 wav 文件，内容与 renderToFile 写出的文件相同（抖动的噪声除外）
+    bool renderToMemory(const std::vector<AudioClip>& clips, std::vector<uint8_t>& fileData) const
+    {
+        AudioFile<float> audio;
+        if (!renderToBuffer(clips, audio))
+        {
+            return false;
+        }
+        audio.setBitDepth(16);
+        audio.setDither(options.dither);
+        return audio.saveToMemory(fileData);
+    }
+
+private:
+    RenderOptions options;
+    ThreadPool* sharedPool = nullptr;
+    SourceCache* sharedSources = nullptr;
+    mutable std::mutex mutex;
+    std::map<std::string, SourceData> memorySources;
+};
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// 前瞻峰值限幅器（立体声联动）。输出比输入晚 getLatency() 个采样，
+// 每个采样需要的增益 ceiling / |x| 在前瞻窗口内取最小值、按释放时间缓慢回升，
+// 再做一次窗口长度的滑动平均使增益变化平滑；最后与该采样本身需要的增益取较小值，
+// 所以输出的绝对值一定不超过 ceiling，和全局归一化一样不会削波，但只需要窗口大小的内存
+class LookaheadLimiter {
+public:
+    LookaheadLimiter(int sampleRate, float ceiling = 0.999f, double lookaheadSeconds = 0.005, double releaseSeconds = 0.1)
+        : window(std::max(1, static_cast<int>(std::lround(lookaheadSeconds * sampleRate)))),
+          ceiling(ceiling),
+          releaseCoef(std::exp(-1.0 / std::max(1.0, releaseSeconds * sampleRate))),
+          delayLeft(window, 0.0f),
+          delayRight(window, 0.0f),
+          delayGain(window, 1.0f),
+          smoothing(window, 1.0)
+    {
+        smoothingSum = static_cast<double>(window);
+    }
+
+    int getLatency() const { return window - 1; }
+
+    // 限幅过程中最小的增益（1 表示从未限幅）
+    float getMinGain() const { return minGain; }
+
+    // 原地处理 count 个采样；写回的是 getLatency() 个采样之前的输入限幅后的结果
+    void process(float* left, float* right, int count)
+    {
+        for (int i = 0; i < count; ++i, ++position) {
+            const float peak = std::max(std::abs(left[i]), std::abs(right[i]));
+            const float required = peak > ceiling ? ceiling / peak : 1.0f;
+
+            // 单调队列维护前瞻窗口内的最小增益
+            while (!minimums.empty() && minimums.back().second >= required) {
+                minimums.pop_back();
+            }
+            minimums.emplace_back(position, required);
+            while (minimums.front().first <= position - window) {
+                minimums.pop_front();
+            }
+
+            // 增益下降立即跟上，回升按释放时间指数逼近 1
+            release = std::min(static_cast<double>(minimums.front().second), 1.0 - (1.0 - release) * releaseCoef);
+
+            const size_t slot = static_cast<size_t>(position % window);
+            smoothingSum += release - smoothing[slot];
+            smoothing[slot] = release;
+            delayLeft[slot] = left[i];
+            delayRight[slot] = right[i];
+            delayGain[slot] = required;
+
+            const size_t delayed = static_cast<size_t>((position + 1) % window);
+            const float gain = std::min(static_cast<float>(smoothingSum / window), delayGain[delayed]);
+            minGain = std::min(minGain, gain);
+            left[i] = delayLeft[delayed] * gain;
+            right[i] = delayRight[delayed] * gain;
+        }
+    }
+
+private:
+    int window;
+    float ceiling;
+    double releaseCoef;
+    std::vector<float> delayLeft;
+    std::vector<float> delayRight;
+    std::vector<float> delayGain;
+    std::vector<double> smoothing;
+    double smoothingSum = 0.0;
+    double release = 1.0;
+    std::deque<std::pair<int64_t, float>> minimums;
+    int64_t position = 0;
+    float minGain = 1.0f;
+};
@@ -0,0 +1,97 @@
+﻿#pragma once
+#include "AudioFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined (__ARM_NEON) || defined (_M_ARM64)
+    #define WAVCOMPOSITOR_NEON 1
+    #include <arm_neon.h>
+#endif
+
+// 增益 + 累加的混音内核：left/right += 片段采样 * volume。
+// 单声道 -> 立体声、立体声 -> 立体声在编译期各生成一份，循环里不再判断声道数。
+// 先乘后加、分两次舍入（不用 FMA），结果与逐个采样计算完全一致；
+// 缓冲区来自 new[] / vector，不保证对齐，所以用不要求对齐的读写指令
+template <bool Mono>
+struct MixKernel {
+    static void process(const float* ch0, const float* ch1, float volume, float* left, float* right, int64_t count)
+    {
+        int64_t i = 0;
+#if defined (AUDIOFILE_AVX2)
+        const __m256 gain8 = _mm256_set1_ps(volume);
+        for (; i + 16 <= count; i += 16) {
+            mix8(ch0 + i, ch1 + i, gain8, left + i, right + i);
+            mix8(ch0 + i + 8, ch1 + i + 8, gain8, left + i + 8, right + i + 8);
+        }
+        for (; i + 8 <= count; i += 8) {
+            mix8(ch0 + i, ch1 + i, gain8, left + i, right + i);
+        }
+#endif
+#if defined (AUDIOFILE_SSE2)
+        const __m128 gain4 = _mm_set1_ps(volume);
+        for (; i + 4 <= count; i += 4) {
+            const __m128 a = _mm_mul_ps(_mm_loadu_ps(ch0 + i), gain4);
+            const __m128 b = Mono ? a : _mm_mul_ps(_mm_loadu_ps(ch1 + i), gain4);
+            _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), a));
+            _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), b));
+        }
+#elif defined (WAVCOMPOSITOR_NEON)
+        const float32x4_t gain4 = vdupq_n_f32(volume);
+        for (; i + 4 <= count; i += 4) {
+            const float32x4_t a = vmulq_f32(vld1q_f32(ch0 + i), gain4);
+            const float32x4_t b = Mono ? a : vmulq_f32(vld1q_f32(ch1 + i), gain4);
+            vst1q_f32(left + i, vaddq_f32(vld1q_f32(left + i), a));
+            vst1q_f32(right + i, vaddq_f32(vld1q_f32(right + i), b));
+        }
+#endif
+        for (; i < count; ++i) {
+            const float a = ch0[i] * volume;
+            const float b = Mono ? a : ch1[i] * volume;
+            left[i] += a;
+            right[i] += b;
+        }
+    }
+
+private:
+#if defined (AUDIOFILE_AVX2)
+    static void mix8(const float* ch0, const float* ch1, __m256 gain, float* left, float* right)
+    {
+        const __m256 a = _mm256_mul_ps(_mm256_loadu_ps(ch0), gain);
+        const __m256 b = Mono ? a : _mm256_mul_ps(_mm256_loadu_ps(ch1), gain);
+        _mm256_storeu_ps(left, _mm256_add_ps(_mm256_loadu_ps(left), a));
+        _mm256_storeu_ps(right, _mm256_add_ps(_mm256_loadu_ps(right), b));
+    }
+#endif
+};
+
+// 立体声两个声道的最大绝对值。max 没有舍入，各条路径的结果完全相同
+inline float peakAbs(const float* left, const float* right, int64_t count)
+{
+    int64_t i = 0;
+    float peak = 0.0f;
+#if defined (AUDIOFILE_SSE2)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 peak4 = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        peak4 = _mm_max_ps(peak4, _mm_andnot_ps(signMask, _mm_loadu_ps(left + i)));
+        peak4 = _mm_max_ps(peak4, _mm_andnot_ps(signMask, _mm_loadu_ps(right + i)));
+    }
+    peak4 = _mm_max_ps(peak4, _mm_movehl_ps(peak4, peak4));
+    peak4 = _mm_max_ss(peak4, _mm_shuffle_ps(peak4, peak4, 1));
+    peak = _mm_cvtss_f32(peak4);
+#elif defined (WAVCOMPOSITOR_NEON)
+    float32x4_t peak4 = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4) {
+        peak4 = vmaxq_f32(peak4, vabsq_f32(vld1q_f32(left + i)));
+        peak4 = vmaxq_f32(peak4, vabsq_f32(vld1q_f32(right + i)));
+    }
+    const float32x2_t peak2 = vpmax_f32(vget_low_f32(peak4), vget_high_f32(peak4));
+    peak = std::max(vget_lane_f32(peak2, 0), vget_lane_f32(peak2, 1));
+#endif
+    for (; i < count; ++i) {
+        peak = std::max(peak, std::abs(left[i]));
+        peak = std::max(peak, std::abs(right[i]));
+    }
+    return peak;
+}
@@ -0,0 +1,491 @@
+﻿#pragma once
+#include "ClipList.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#if defined (__linux__) && defined (__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #include <sys/mman.h>
+        #include <sys/stat.h>
+        #include <sys/syscall.h>
+        #include <sys/uio.h>
+        #include <fcntl.h>
+        #include <unistd.h>
+        #if defined (__NR_io_uring_setup) && defined (__NR_io_uring_enter)
+            #define WAVCOMPOSITOR_IO_URING 1
+        #endif
+    #endif
+#endif
+
+#if defined (WAVCOMPOSITOR_IO_URING)
+// 最小的 io_uring 封装，直接使用系统调用，不依赖 liburing。只有一个线程提交和收割
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring()
+    {
+        if (sqes != nullptr) munmap(sqes, sqesSize);
+        if (cqRing != nullptr) munmap(cqRing, cqRingSize);
+        if (sqRing != nullptr) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    // 内核不支持或 io_uring 被禁用（容器、seccomp）时返回 false
+    bool init(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0)
+        {
+            return false;
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = mapRing(cqRingSize, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+        if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr)
+        {
+            return false;
+        }
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        numEntries = params.sq_entries;
+        return true;
+    }
+
+    unsigned size() const { return numEntries; }
+
+    // 排队一个读请求，iov 在完成之前必须保持有效。队列满时返回 false
+    bool queueRead(int fd, const iovec* iov, uint64_t offset, uint64_t userData)
+    {
+        const unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= numEntries)
+        {
+            return false;
+        }
+        const unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(iov);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++pending;
+        return true;
+    }
+
+    // 提交排队的请求，waitFor 大于 0 时等到至少有这么多个请求完成
+    bool submit(unsigned waitFor)
+    {
+        for (;;)
+        {
+            const long submitted = syscall(__NR_io_uring_enter, ringFd, pending, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted >= 0)
+            {
+                pending -= static_cast<unsigned>(submitted);
+                return true;
+            }
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+    }
+
+    // 取出一个完成的请求，没有时返回 false
+    bool reap(uint64_t& userData, int& result)
+    {
+        const unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+        const io_uring_cqe& cqe = cqes[head & cqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    void* mapRing(size_t size, off_t offset)
+    {
+        void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return ring == MAP_FAILED ? nullptr : ring;
+    }
+
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned numEntries = 0;
+    unsigned pending = 0;
+};
+#endif
+
+// 预读（--prefetch）：按片段的使用顺序，提前把后面片段的文件读进页缓存，解码、混音前面的片段时，
+// 磁盘或网络卷已经在读后面的文件，之后映射文件解码时不必再等 I/O。
+// 窗口内最多有 window 个还没用到的片段在预读，同一个文件（截取的片段是同一段）只读一次，读到的数据直接丢弃。
+// 截取了一段的片段只读文件头和这一段对应的采样数据，不把整个长文件读进来。
+// Linux 上用 io_uring 同时发出多个读请求；内核不支持或被禁用时（以及其他平台）退回到几个后台线程顺序读取
+class Prefetcher {
+public:
+    // order 为片段的使用顺序（clips 的下标），为空时按输入顺序。clips 必须比 Prefetcher 活得久
+    Prefetcher(const std::vector<AudioClip>& clips, std::vector<size_t> order, size_t window)
+        : clips(clips), order(std::move(order)), window(window)
+    {
+#if defined (WAVCOMPOSITOR_IO_URING)
+        if (ring.init(queueDepth))
+        {
+            workers.emplace_back([this] { uringLoop(); });
+            return;
+        }
+#endif
+        for (int i = 0; i < fallbackThreads; ++i)
+        {
+            workers.emplace_back([this] { readLoop(); });
+        }
+    }
+
+    ~Prefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    // 前 position 个片段已经开始使用，窗口随之前移
+    void advance(size_t position)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (position <= consumed)
+            {
+                return;
+            }
+            consumed = position;
+        }
+        changed.notify_all();
+    }
+
+private:
+    static constexpr size_t chunkSize = 256 * 1024;
+    static constexpr unsigned queueDepth = 32;
+    static constexpr int fallbackThreads = 4;
+
+    using ByteRange = std::pair<uint64_t, uint64_t>; // [起点, 终点)
+
+    // 一个预读任务。ranges 为空时读整个文件
+    struct Job {
+        std::string path;
+        std::vector<ByteRange> ranges;
+    };
+
+    // 截取了一段的片段要读的字节范围：文件头和这一段采样数据。解析不了文件头或截取的是整个文件时返回 false，整个读
+    static bool sliceRanges(const AudioClip& clip, std::vector<ByteRange>& ranges)
+    {
+        AudioFileReader<float> reader;
+        reader.shouldLogErrorsToConsole(false);
+        if (!clip.isSlice() || !reader.open(clip.filename))
+        {
+            return false;
+        }
+        int64_t startSample = 0;
+        int64_t numSamples = 0;
+        clipSourceRange(clip, reader.getSampleRate(), reader.getNumSamplesPerChannel(), startSample, numSamples);
+        if (startSample == 0 && numSamples == reader.getNumSamplesPerChannel())
+        {
+            return false;
+        }
+        const uint64_t frameBytes = static_cast<uint64_t>(reader.getNumChannels()) * static_cast<uint64_t>(reader.getBitDepth() / 8);
+        const uint64_t dataStart = reader.getSampleDataOffset();
+        ranges.assign(1, ByteRange(0, dataStart));
+        if (numSamples > 0)
+        {
+            ranges.emplace_back(dataStart + static_cast<uint64_t>(startSample) * frameBytes, dataStart + static_cast<uint64_t>(startSample + numSamples) * frameBytes);
+        }
+        return true;
+    }
+
+    // 取窗口内下一个没读过的文件（或文件中的一段）。没有时 wait 为真就等到有文件或者停止，否则直接返回 false
+    bool takeNext(Job& job, bool wait)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            const size_t count = clips.size();
+            while (!stopping && issued < count && issued < consumed + window)
+            {
+                const size_t index = order.empty() ? issued : order[issued];
+                ++issued;
+                const AudioClip& clip = clips[index];
+                if (seen.count(clip.filename) != 0)
+                {
+                    continue; // 整个文件已经读过
+                }
+                if (clip.isSlice())
+                {
+                    char range[64];
+                    std::snprintf(range, sizeof(range), "\n%.17g\n%.17g", clip.offset, clip.length);
+                    if (!seen.insert(clip.filename + range).second)
+                    {
+                        continue;
+                    }
+                }
+                // 解析文件头要读盘，放到锁外面做
+                lock.unlock();
+                job.path = clip.filename;
+                job.ranges.clear();
+                if (!sliceRanges(clip, job.ranges))
+                {
+                    job.ranges.clear();
+                    lock.lock();
+                    if (!seen.insert(clip.filename).second)
+                    {
+                        continue;
+                    }
+                }
+                return true;
+            }
+            if (stopping || !wait)
+            {
+                return false;
+            }
+            changed.wait(lock);
+        }
+    }
+
+    bool isStopping()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stopping;
+    }
+
+    // 线程版：每个线程一次读一个文件，块与块之间检查是否该停止
+    void readLoop()
+    {
+        std::vector<char> scratch(chunkSize);
+        Job job;
+        while (takeNext(job, true))
+        {
+            ProfileScope scope("prefetch");
+            std::ifstream file(job.path, std::ios::binary);
+            if (job.ranges.empty())
+            {
+                job.ranges.emplace_back(0, UINT64_MAX);
+            }
+            for (const ByteRange& range : job.ranges)
+            {
+                file.clear();
+                file.seekg(static_cast<std::streamoff>(range.first));
+                for (uint64_t position = range.first; file && position < range.second && !isStopping();)
+                {
+                    file.read(scratch.data(), static_cast<std::streamsize>(std::min<uint64_t>(scratch.size(), range.second - position)));
+                    position += static_cast<uint64_t>(file.gcount());
+                    Profiler::count("bytes prefetched", file.gcount());
+                }
+            }
+        }
+    }
+
+#if defined (WAVCOMPOSITOR_IO_URING)
+    struct OpenFile {
+        int fd = -1;
+        std::vector<ByteRange> ranges; // 还要读的范围，按顺序读
+        size_t range = 0;              // 正在读的范围
+        uint64_t nextOffset = 0;
+        int inFlight = 0;
+
+        bool finished() const { return range >= ranges.size(); }
+    };
+
+    // io_uring 版：一个线程按顺序给窗口内的文件发出分块读请求，最多 queueDepth 个同时进行。
+    // 数据都读进同一块缓冲区后丢弃，所以各请求共用它；只是每个请求读的长度不同，各占一个 iovec。
+    // user_data 低 32 位是 files 的下标，高 32 位是 iovec 的编号
+    void uringLoop()
+    {
+        std::vector<char> scratch(chunkSize);
+        std::vector<iovec> iovs(queueDepth);
+        std::vector<uint32_t> freeSlots;
+        for (uint32_t slot = queueDepth; slot > 0; --slot)
+        {
+            freeSlots.push_back(slot - 1);
+        }
+        std::vector<OpenFile> files;
+        unsigned inFlight = 0;
+        for (;;)
+        {
+            // 打开的文件不到一半队列深度时再打开新的文件，保持队列里有请求
+            size_t openFiles = static_cast<size_t>(std::count_if(files.begin(), files.end(), [](const OpenFile& file) { return file.fd >= 0; }));
+            Job job;
+            while (openFiles < queueDepth / 2 && takeNext(job, inFlight == 0 && openFiles == 0))
+            {
+                OpenFile file;
+                file.fd = open(job.path.c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat info;
+                if (file.fd < 0)
+                {
+                    continue;
+                }
+                if (fstat(file.fd, &info) != 0 || info.st_size <= 0)
+                {
+                    close(file.fd);
+                    continue;
+                }
+                const uint64_t size = static_cast<uint64_t>(info.st_size);
+                if (job.ranges.empty())
+                {
+                    job.ranges.emplace_back(0, size);
+                }
+                for (const ByteRange& range : job.ranges)
+                {
+                    if (range.first < std::min(range.second, size))
+                    {
+                        file.ranges.emplace_back(range.first, std::min(range.second, size));
+                    }
+                }
+                if (file.ranges.empty())
+                {
+                    close(file.fd);
+                    continue;
+                }
+                file.nextOffset = file.ranges.front().first;
+                files.push_back(std::move(file));
+                ++openFiles;
+            }
+            if (openFiles == 0 && inFlight == 0)
+            {
+                return; // 停止了
+            }
+
+            const bool stop = isStopping();
+            // 提交之后提交队列就空出来了，进行中的请求数要单独限制在 queueDepth 以内
+            for (size_t f = 0; !stop && f < files.size() && inFlight < queueDepth; ++f)
+            {
+                OpenFile& file = files[f];
+                while (!file.finished() && inFlight < queueDepth)
+                {
+                    const uint32_t slot = freeSlots.back();
+                    const uint64_t end = file.ranges[file.range].second;
+                    iovs[slot].iov_base = scratch.data();
+                    iovs[slot].iov_len = static_cast<size_t>(std::min<uint64_t>(chunkSize, end - file.nextOffset));
+                    if (!ring.queueRead(file.fd, &iovs[slot], file.nextOffset, f | (static_cast<uint64_t>(slot) << 32)))
+                    {
+                        break;
+                    }
+                    freeSlots.pop_back();
+                    file.nextOffset += iovs[slot].iov_len;
+                    if (file.nextOffset >= end && ++file.range < file.ranges.size())
+                    {
+                        file.nextOffset = file.ranges[file.range].first;
+                    }
+                    ++file.inFlight;
+                    ++inFlight;
+                }
+            }
+            if (!ring.submit(inFlight > 0 ? 1 : 0))
+            {
+                // 提交失败时不再有新的完成事件，只能放弃这些文件；内核里已有的请求由关闭 ring 时取消
+                for (OpenFile& file : files)
+                {
+                    close(file.fd);
+                }
+                return;
+            }
+
+            uint64_t userData = 0;
+            int result = 0;
+            while (ring.reap(userData, result))
+            {
+                OpenFile& file = files[static_cast<size_t>(userData & 0xFFFFFFFFu)];
+                freeSlots.push_back(static_cast<uint32_t>(userData >> 32));
+                --file.inFlight;
+                --inFlight;
+                if (result > 0)
+                {
+                    Profiler::count("bytes prefetched", result);
+                }
+                else
+                {
+                    file.range = file.ranges.size(); // 出错或已到文件末尾，不再继续读
+                }
+            }
+            // 读完（或停止时已没有进行中的请求）的文件关掉。files 的下标就是 user_data，只在没有请求进行时才整理
+            for (OpenFile& file : files)
+            {
+                if ((file.finished() || stop) && file.inFlight == 0 && file.fd >= 0)
+                {
+                    close(file.fd);
+                    file.fd = -1;
+                }
+            }
+            if (inFlight == 0)
+            {
+                files.erase(std::remove_if(files.begin(), files.end(), [](const OpenFile& file) { return file.fd < 0; }), files.end());
+            }
+        }
+    }
+
+    IoUring ring;
+#endif
+
+    const std::vector<AudioClip>& clips;
+    std::vector<size_t> order;
+    size_t window;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping = false;
+    size_t issued = 0;   // order 中已经考虑过的片段数
+    size_t consumed = 0; // 已经开始使用的片段数
+    std::unordered_set<std::string> seen;
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,253 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined (_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+// 性能剖析（--profile）：作用域计时器和计数器。
+// 未启用时 ProfileScope 只读一次原子标志，几乎没有开销；启用后每个线程把事件记在自己的缓冲区里，
+// 不需要加锁，渲染结束后汇总成各阶段的耗时表，也可以写成 Chrome trace（chrome://tracing、Perfetto）查看各线程的活动。
+// 进程的峰值内存只在阶段边界（标为 stage 的作用域结束时）读取一次，热循环里的作用域不做系统调用
+class Profiler {
+public:
+    struct Event {
+        const char* name;
+        int64_t start;    // 纳秒，相对 enable() 的时刻
+        int64_t duration;
+        int64_t peakRss;  // 阶段边界上读到的进程峰值常驻内存（字节），其他事件为 -1
+    };
+
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static bool enabled()
+    {
+        return instance().active.load(std::memory_order_relaxed);
+    }
+
+    void enable()
+    {
+        origin = std::chrono::steady_clock::now();
+        threadLog(); // 调用线程（主线程）登记为 0 号线程
+        active.store(true, std::memory_order_relaxed);
+    }
+
+    int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(const char* name, int64_t start, int64_t end, bool stage)
+    {
+        threadLog().events.push_back({ name, start, end - start, stage ? peakRss() : -1 });
+    }
+
+    // 丢弃已记录的事件和计数器，常驻进程靠它让缓冲区不随任务数增长。
+    // 各线程的缓冲区由它们自己在下次记录时清空，不需要加锁；汇总时跳过还没清空的旧缓冲区
+    void reset()
+    {
+        generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // 计数器累加到当前线程，汇总时按名字合并
+    static void count(const char* name, int64_t value)
+    {
+        if (!enabled()) {
+            return;
+        }
+        std::vector<std::pair<const char*, int64_t>>& counters = instance().threadLog().counters;
+        for (auto& counter : counters) {
+            if (std::strcmp(counter.first, name) == 0) {
+                counter.second += value;
+                return;
+            }
+        }
+        counters.emplace_back(name, value);
+    }
+
+    static int64_t peakRss()
+    {
+#if defined (_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return static_cast<int64_t>(counters.PeakWorkingSetSize);
+        }
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+    #if defined (__APPLE__)
+        return static_cast<int64_t>(usage.ru_maxrss);
+    #else
+        return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+    #endif
+#endif
+    }
+
+    // 必须在所有工作线程结束之后调用
+    void printSummary() const
+    {
+        struct Stage {
+            int64_t calls = 0;
+            int64_t total = 0;
+            int64_t longest = 0;
+            int64_t peakRss = -1;
+        };
+        std::map<std::string, Stage> stages;
+        std::map<std::string, int64_t> counters;
+        for (const auto& log : logs) {
+            if (log->generation != generation.load(std::memory_order_acquire)) {
+                continue;
+            }
+            for (const Event& event : log->events) {
+                Stage& stage = stages[event.name];
+                ++stage.calls;
+                stage.total += event.duration;
+                stage.longest = std::max(stage.longest, event.duration);
+                stage.peakRss = std::max(stage.peakRss, event.peakRss);
+            }
+            for (const auto& counter : log->counters) {
+                counters[counter.first] += counter.second;
+            }
+        }
+
+        // 最后一列是阶段结束时整个进程的峰值内存（不是这个阶段自己用的内存），只有阶段边界才有
+        std::printf("\n%-24s %10s %12s %12s %12s %18s\n", "Stage", "Calls", "Total ms", "Avg ms", "Max ms", "Process peak MiB");
+        for (const auto& entry : stages) {
+            const Stage& stage = entry.second;
+            std::printf("%-24s %10lld %12.3f %12.3f %12.3f ", entry.first.c_str(), static_cast<long long>(stage.calls),
+                stage.total / 1e6, stage.total / 1e6 / stage.calls, stage.longest / 1e6);
+            if (stage.peakRss >= 0) {
+                std::printf("%18.1f\n", stage.peakRss / 1048576.0);
+            }
+            else {
+                std::printf("%18s\n", "-");
+            }
+        }
+        if (!counters.empty()) {
+            std::printf("\n%-24s %20s\n", "Counter", "Value");
+            for (const auto& counter : counters) {
+                std::printf("%-24s %20lld\n", counter.first.c_str(), static_cast<long long>(counter.second));
+            }
+        }
+        std::printf("Wall time %.3f ms, peak RSS %.1f MiB\n", now() / 1e6, peakRss() / 1048576.0);
+    }
+
+    // Chrome trace-event JSON：每个作用域一个 "X" 事件，结束时每个计数器一个 "C" 事件
+    bool writeTrace(const std::string& path) const
+    {
+        std::ofstream trace(path);
+        trace << "{\"traceEvents\":[\n";
+        trace << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"wavCompositorExtended\"}}";
+        std::map<std::string, int64_t> counters;
+        char line[512];
+        for (const auto& log : logs) {
+            if (log->generation != generation.load(std::memory_order_acquire)) {
+                continue;
+            }
+            std::snprintf(line, sizeof(line), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                log->tid, log->tid == 0 ? "main" : "worker", log->tid);
+            trace << line;
+            for (const Event& event : log->events) {
+                std::snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, log->tid, event.start / 1e3, event.duration / 1e3);
+                trace << line;
+            }
+            for (const auto& counter : log->counters) {
+                counters[counter.first] += counter.second;
+            }
+        }
+        const double end = now() / 1e3;
+        for (const auto& counter : counters) {
+            std::snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                counter.first.c_str(), end, static_cast<long long>(counter.second));
+            trace << line;
+        }
+        trace << "\n]}\n";
+        return static_cast<bool>(trace);
+    }
+
+private:
+    struct ThreadLog {
+        int tid = 0;
+        uint64_t generation = 0;
+        std::vector<Event> events;
+        std::vector<std::pair<const char*, int64_t>> counters;
+    };
+
+    // 每个线程第一次记录时登记自己的缓冲区；缓冲区归 Profiler 所有，线程退出后仍然有效
+    ThreadLog& threadLog()
+    {
+        thread_local ThreadLog* log = nullptr;
+        if (log == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            logs.push_back(std::make_unique<ThreadLog>());
+            log = logs.back().get();
+            log->tid = static_cast<int>(logs.size() - 1);
+        }
+        const uint64_t current = generation.load(std::memory_order_acquire);
+        if (log->generation != current) {
+            log->events.clear();
+            log->counters.clear();
+            log->generation = current;
+        }
+        return *log;
+    }
+
+    std::atomic<bool> active{ false };
+    std::atomic<uint64_t> generation{ 0 };
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadLog>> logs;
+};
+
+// 作用域计时器：构造时记下开始时间，析构时记录一个事件。name 必须是字符串字面量。
+// stage 为真的作用域是阶段边界（解析、扩容、写出等不在热循环里的作用域），结束时顺便记下进程的峰值内存
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name, bool stage = false)
+        : name(name), start(Profiler::enabled() ? Profiler::instance().now() : -1), stage(stage)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (start >= 0) {
+            Profiler::instance().record(name, start, Profiler::instance().now(), stage);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    int64_t start;
+    bool stage;
+};
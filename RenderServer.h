@@ -0,0 +1,319 @@
+﻿#pragma once
+#include "Compositor.h"
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined (_WIN32)
+    #include <winsock2.h>
+    #include <afunix.h>
+    #pragma comment(lib, "Ws2_32.lib")
+#else
+    #include <cerrno>
+    #include <csignal>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+// --serve：常驻进程，在本地 Unix 域套接字上接受渲染任务，省掉每次启动进程和重新解码音源的开销。
+// 每个连接是一个任务：第一行是输出文件路径（"-" 表示把 wav 从套接字传回），其余内容是片段列表，
+// 格式与输入文件相同（文本或二进制），客户端写完后关闭写端。
+// 回复一行 "OK <采样数> <wav 字节数>"，输出为 "-" 时随后是 wav 数据（否则字节数为 0）；失败时回复 "ERROR <原因>"。
+// 解码、重采样好的音源常驻内存，按最近使用淘汰，总大小不超过 --cache-budget；所有任务共用一个线程池。
+// 每个任务要缓存整个请求、分配整条时间线，所以请求大小和同时进行的任务数（--max-jobs）都有上限。
+// 任务可以指定任意输出路径，所以套接字文件只允许本用户访问（0600）
+class RenderServer {
+public:
+    explicit RenderServer(const RenderOptions& renderOptions)
+        : options(renderOptions), pool(renderOptions.jobs), sources(renderOptions.cacheBudget)
+    {
+        options.verbose = false;
+    }
+
+    // 监听 socketPath 并处理任务，只在出错时返回
+    int run(const std::string& socketPath)
+    {
+#if defined (_WIN32)
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        {
+            std::printf("Failed to initialize Winsock\n");
+            return 1;
+        }
+#else
+        // 客户端提前断开时让 send 返回错误，而不是结束进程
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            std::printf("Socket path too long: %s\n", socketPath.c_str());
+            return 1;
+        }
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+        // 只删除上次退出时留下的套接字文件；路径上是别的文件（多半是写错了路径）时不动它。
+        // 还有服务在监听的套接字也不能删，否则那个服务仍在运行却再也连不上
+        std::error_code error;
+        const std::filesystem::file_status existing = std::filesystem::symlink_status(socketPath, error);
+        if (std::filesystem::exists(existing))
+        {
+            if (existing.type() != std::filesystem::file_type::socket)
+            {
+                std::printf("%s exists and is not a socket\n", socketPath.c_str());
+                return 1;
+            }
+            if (!isStale(address))
+            {
+                std::printf("%s is already in use\n", socketPath.c_str());
+                return 1;
+            }
+            std::remove(socketPath.c_str());
+        }
+
+        Socket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == invalidSocket)
+        {
+            std::printf("Failed to create socket\n");
+            return 1;
+        }
+        const bool bound = bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        bool listening = bound;
+#if !defined (_WIN32)
+        // 在 listen 之前收紧权限，这之前没有人能连上
+        listening = listening && chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) == 0;
+#endif
+        if (!listening || listen(listener, 64) != 0)
+        {
+            std::printf("Failed to listen on %s\n", socketPath.c_str());
+            closeSocket(listener);
+            if (bound)
+            {
+                std::remove(socketPath.c_str());
+            }
+            return 1;
+        }
+        std::printf("Listening on %s (%d threads, cache budget %lld MiB, up to %d jobs at once)\n", socketPath.c_str(), pool.size(),
+            static_cast<long long>(options.cacheBudget / 1048576), options.maxJobs);
+        std::fflush(stdout);
+
+        // 固定 maxJobs 个线程各自接受连接、处理任务，多出来的连接在 listen 队列里等待。
+        // 线程是固定的，剖析器给每个线程登记的缓冲区也就不随任务数增长
+        std::atomic<uint64_t> nextJobId{ 1 };
+        std::vector<std::thread> handlers;
+        for (int i = 0; i < options.maxJobs; ++i)
+        {
+            handlers.emplace_back([this, listener, &nextJobId] { acceptLoop(listener, nextJobId); });
+        }
+        // 等正在进行的任务结束，它们用到的线程池和缓存属于 this
+        for (std::thread& handler : handlers)
+        {
+            handler.join();
+        }
+        closeSocket(listener);
+        std::remove(socketPath.c_str());
+        return 1;
+    }
+
+private:
+#if defined (_WIN32)
+    using Socket = SOCKET;
+    static constexpr Socket invalidSocket = INVALID_SOCKET;
+    static void closeSocket(Socket s) { closesocket(s); }
+    static void shutdownSocket(Socket s) { shutdown(s, SD_BOTH); }
+    static bool connectionRefused() { return WSAGetLastError() == WSAECONNREFUSED; }
+#else
+    using Socket = int;
+    static constexpr Socket invalidSocket = -1;
+    static void closeSocket(Socket s) { close(s); }
+    static void shutdownSocket(Socket s) { shutdown(s, SHUT_RDWR); }
+    static bool connectionRefused() { return errno == ECONNREFUSED; }
+#endif
+
+    // 一个请求（输出路径 + 片段列表）的大小上限，二进制格式下够放上千万个片段
+    static constexpr size_t maxRequestBytes = size_t(256) << 20;
+
+    // 连不上已有的套接字文件（连接被拒绝）说明没有进程在监听，是上次退出时留下的
+    static bool isStale(const sockaddr_un& address)
+    {
+        Socket probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe == invalidSocket)
+        {
+            return false;
+        }
+        const bool refused = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 && connectionRefused();
+        closeSocket(probe);
+        return refused;
+    }
+
+    // 处理任务的线程：接受一个连接、处理完再接受下一个。accept 出错时关闭监听套接字，唤醒其他线程一起退出
+    void acceptLoop(Socket listener, std::atomic<uint64_t>& nextJobId)
+    {
+        for (;;)
+        {
+            Socket client = accept(listener, nullptr, nullptr);
+            if (client == invalidSocket)
+            {
+#if !defined (_WIN32)
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+#endif
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!stopping)
+                {
+                    stopping = true;
+                    std::printf("Failed to accept a connection\n");
+                    shutdownSocket(listener);
+                }
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++activeJobs;
+            }
+            handle(client, nextJobId++);
+            closeSocket(client);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (Profiler::enabled())
+            {
+                // 没有别的任务在运行时各线程都已空闲，可以安全地汇总；之后丢弃记录，缓冲区不随任务数增长
+                if (activeJobs == 1)
+                {
+                    Profiler::instance().printSummary();
+                    std::fflush(stdout);
+                }
+                Profiler::instance().reset();
+            }
+            --activeJobs;
+        }
+    }
+
+    static bool sendAll(Socket client, const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+            const auto sent = send(client, bytes, chunk, 0);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    static bool reply(Socket client, const std::string& line)
+    {
+        return sendAll(client, line.data(), line.size());
+    }
+
+    void handle(Socket client, uint64_t jobId)
+    {
+        const auto started = std::chrono::steady_clock::now();
+        std::string request;
+        std::vector<char> chunk(65536);
+        for (;;)
+        {
+            const auto received = recv(client, chunk.data(), static_cast<int>(chunk.size()), 0);
+            if (received < 0)
+            {
+                return;
+            }
+            if (received == 0)
+            {
+                break;
+            }
+            if (request.size() + static_cast<size_t>(received) > maxRequestBytes)
+            {
+                reply(client, "ERROR Request too large\n");
+                return;
+            }
+            request.append(chunk.data(), static_cast<size_t>(received));
+        }
+
+        const size_t newline = request.find('\n');
+        if (newline == std::string::npos)
+        {
+            reply(client, "ERROR Missing output line\n");
+            return;
+        }
+        std::string output = request.substr(0, newline);
+        while (!output.empty() && std::isspace(static_cast<unsigned char>(output.back())))
+        {
+            output.pop_back();
+        }
+        std::vector<AudioClip> clips;
+        try
+        {
+            clips = ClipList::parse(reinterpret_cast<const uint8_t*>(request.data()) + newline + 1, request.size() - newline - 1, options.jobs);
+        }
+        catch (const std::exception& e)
+        {
+            reply(client, std::string("ERROR ") + e.what() + "\n");
+            return;
+        }
+        if (clips.empty())
+        {
+            reply(client, "ERROR No valid clips found.\n");
+            return;
+        }
+
+        Compositor compositor(options, pool, sources);
+        int64_t numSamples = 0;
+        std::vector<uint8_t> wav;
+        bool rendered = false;
+        if (output == "-")
+        {
+            AudioFile<float> audio;
+            rendered = compositor.renderToBuffer(clips, audio);
+            if (rendered)
+            {
+                numSamples = audio.getNumSamplesPerChannel();
+                audio.setBitDepth(16);
+                audio.setDither(options.dither);
+                rendered = audio.saveToMemory(wav);
+            }
+        }
+        else
+        {
+            WavFileSink sink(output, options.dither);
+            rendered = compositor.render(clips, sink);
+            numSamples = sink.getNumSamples();
+        }
+        if (!rendered)
+        {
+            reply(client, "ERROR Failed to render " + output + "\n");
+            return;
+        }
+        const bool sent = reply(client, "OK " + std::to_string(numSamples) + " " + std::to_string(wav.size()) + "\n")
+            && sendAll(client, wav.data(), wav.size());
+
+        const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        std::printf("Job %llu: %zu clips -> %s, %.2f seconds in %.1f ms, %zu sources resident (%lld MiB)%s\n",
+            static_cast<unsigned long long>(jobId), clips.size(), output.c_str(), static_cast<double>(numSamples) / options.sampleRate,
+            elapsed, sources.size(), static_cast<long long>(sources.getResidentBytes() / 1048576), sent ? "" : ", client disconnected");
+        std::fflush(stdout); // 日志通常重定向到文件
+    }
+
+    RenderOptions options;
+    ThreadPool pool;
+    SourceCache sources;
+    std::mutex mutex;
+    int activeJobs = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,144 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 固定线程数的线程池
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads)
+    {
+        numThreads = std::max(numThreads, 1);
+        for (int i = 0; i < numThreads; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const
+    {
+        return static_cast<int>(workers.size());
+    }
+
+    // 提交一个任务，通过 future 取得结果（或任务抛出的异常）
+    template <typename F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue([packaged] { (*packaged)(); });
+        return result;
+    }
+
+    // 对 [0, count) 的每个下标并行调用 body，调用线程也参与执行，全部完成后返回。
+    // 因为调用线程自己也会取任务，所以在线程池的任务里再调用 parallelFor 也不会死锁。
+    void parallelFor(size_t count, const std::function<void(size_t)>& body)
+    {
+        if (count == 0) {
+            return;
+        }
+        struct State {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<size_t> done{ 0 };
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::exception_ptr error;
+        };
+        auto state = std::make_shared<State>();
+
+        // 晚启动的辅助任务取不到下标时不会再访问 body，所以按引用捕获是安全的
+        auto run = [state, count, &body] {
+            size_t i;
+            while ((i = state->next.fetch_add(1)) < count) {
+                try {
+                    body(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                }
+                if (state->done.fetch_add(1) + 1 == count) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        // 辅助任务插到队列最前面，不必等排在前面的解码任务
+        const size_t helpers = std::min(count - 1, workers.size());
+        for (size_t h = 0; h < helpers; ++h) {
+            enqueue(run, true);
+        }
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&] { return state->done.load() == count; });
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+private:
+    void enqueue(std::function<void()> task, bool urgent = false)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (urgent) {
+                tasks.push_front(std::move(task));
+            }
+            else {
+                tasks.push_back(std::move(task));
+            }
+        }
+        condition.notify_one();
+    }
+
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
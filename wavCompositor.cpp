@@ -1,178 +1,929 @@
 ﻿#include "AudioFile.h"
+#include "ThreadPool.h"
+#include "Resampler.h"
+#include "MixKernels.h"
+#include "Limiter.h"
+#include "ClipList.h"
+#include "Profiler.h"
+#include "Compositor.h"
+#include "RenderServer.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cassert>
 #include <cctype>
 #include <stdexcept>
 #include <cmath>
 #include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <numeric>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <future>
+#include <atomic>
+#include <thread>
 
 //wavCompositorExtended
 
-// ✅ 正确的线性插值重采样
-template <typename T>
-bool resampleAudio(std::vector<T>& input, int sr, int newsr) {
-    static_assert(std::is_floating_point_v<T> || std::is_integral_v<T>, "T must be numeric");
-    if (sr == newsr || input.empty() || sr <= 0 || newsr <= 0) {
-        return true;
+// 读取片段列表（文本或二进制格式），片段不多时逐个列出
+std::vector<struct AudioClip> parseInputFile(const std::string& filename, int jobs) {
+    ProfileScope scope("parse clip list", true);
+    std::printf("reading:%s\n", filename.c_str());
+    std::vector<struct AudioClip> clips = ClipList::load(filename, jobs);
+
+    if (clips.size() <= 64) {
+        std::printf("File name\tVolume|Start time\n");
+        for (const AudioClip& clip : clips) {
+            std::printf("%s\t%.2f|%.2f\n", clip.filename.c_str(), clip.volume, clip.startTime);
+        }
+    }
+    else {
+        std::printf("%zu clips\n", clips.size());
     }
+    return clips;
+}
 
-    int oldSize = static_cast<int>(input.size());
-    int newSize = static_cast<int>(std::round(static_cast<double>(oldSize) * newsr / sr));
+// --limiter 的输出端：混好的块经过限幅器后直接交给 writer。
+// 静音先只计数，后面又出现声音时才补写，末尾静音自然被裁掉，不需要事先知道最后一个非零采样的位置
+struct LimitedOutput {
+    LookaheadLimiter limiter;
+    AudioFileWriter<float>& writer;
+    int64_t skip;               // 限幅器的延迟：开头这么多个输出采样不属于时间线
+    int64_t pendingSilence = 0; // 还没写出的静音
+    int64_t written = 0;
+    std::vector<float> silence;
 
-    if (newSize == 0) {
-        input.clear();
-        return true;
+    LimitedOutput(int sampleRate, AudioFileWriter<float>& writer)
+        : limiter(sampleRate), writer(writer), skip(limiter.getLatency())
+    {
+    }
+
+    bool write(float* left, float* right, int count)
+    {
+        limiter.process(left, right, count);
+        const int from = static_cast<int>(std::min<int64_t>(skip, count));
+        skip -= from;
+        int last = count - 1;
+        while (last >= from && left[last] == 0 && right[last] == 0)
+        {
+            --last;
+        }
+        if (last < from)
+        {
+            pendingSilence += count - from;
+            return true;
+        }
+        while (pendingSilence > 0)
+        {
+            silence.resize(static_cast<size_t>(std::max(count, 1)), 0.0f);
+            const int n = static_cast<int>(std::min<int64_t>(pendingSilence, static_cast<int64_t>(silence.size())));
+            const float* channels[] = { silence.data(), silence.data() };
+            if (!writer.write(channels, n))
+            {
+                return false;
+            }
+            pendingSilence -= n;
+            written += n;
+        }
+        const float* channels[] = { left + from, right + from };
+        pendingSilence = count - 1 - last;
+        written += last + 1 - from;
+        return writer.write(channels, last + 1 - from);
     }
 
-    std::vector<T> output;
-    output.reserve(newSize);
+    // 送入与延迟等长的静音，把限幅器里剩下的采样推出来
+    bool finish()
+    {
+        std::vector<float> tailLeft(static_cast<size_t>(limiter.getLatency()), 0.0f);
+        std::vector<float> tailRight(tailLeft.size(), 0.0f);
+        return tailLeft.empty() || write(tailLeft.data(), tailRight.data(), static_cast<int>(tailLeft.size()));
+    }
+};
 
-    for (int i = 0; i < newSize; ++i) {
-        double oldIndex = static_cast<double>(i) * sr / newsr;
-        int left = static_cast<int>(std::floor(oldIndex));
-        int right = left + 1;
+// 流式渲染：按固定窗口遍历时间线，只加载与当前窗口重叠的片段，片段结束后立即释放。
+// 混音结果先写入临时文件，同时记录峰值和最后一个非零采样，最后再归一化写出 wav，
+// 峰值内存只取决于窗口大小和同时发声的片段数，与总时长无关。
+// 使用 --limiter 时不做全局归一化，每块混完经过前瞻限幅器直接写出，不需要临时文件
+static int renderStreaming(const std::vector<AudioClip>& clips, const RenderOptions& options)
+{
+    const int sampleRate = options.sampleRate;
+    const std::string& outputFile = options.outputFile;
+    const int blockSize = options.blockSize;
 
-        T sample;
+    std::vector<size_t> order(clips.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&clips](size_t a, size_t b) {
+        return clips[a].startTime < clips[b].startTime;
+    });
 
-        if (right >= oldSize) {
-            sample = input[oldSize - 1];
+    AudioFileWriter<float> writer;
+    writer.setDither(options.dither);
+    std::unique_ptr<LimitedOutput> limited;
+    const std::string tempFile = outputFile + ".part";
+    std::ofstream temp;
+    if (options.limiter)
+    {
+        if (!writer.open(outputFile, sampleRate, 2, 16))
+        {
+            std::cerr << "Failed to save: " << outputFile << "\n";
+            return 1;
         }
-        else if (left < 0) {
-            sample = input[0];
+        limited = std::make_unique<LimitedOutput>(sampleRate, writer);
+    }
+    else
+    {
+        temp.open(tempFile, std::ios::binary | std::ios::trunc);
+        if (!temp.is_open())
+        {
+            std::cerr << "Cannot open temporary file: " << tempFile << "\n";
+            return 1;
         }
-        else {
-            double t = oldIndex - left;
-            sample = static_cast<T>(input[left] * (1 - t) + input[right] * t);
+    }
+
+    std::vector<float> left(blockSize), right(blockSize), interleaved(static_cast<size_t>(blockSize) * 2);
+    std::vector<ActiveClip> active;
+    size_t next = 0;
+    int64_t blockStart = 0;
+    int64_t lastNonZero = -1;
+    float maxVal = 0.0f;
+
+    ThreadPool pool(options.jobs);
+    // 按开始时间预读后面的片段，片段激活时文件已经在页缓存里
+    std::unique_ptr<Prefetcher> prefetcher;
+    if (options.prefetch > 0)
+    {
+        prefetcher = std::make_unique<Prefetcher>(clips, order, static_cast<size_t>(options.prefetch));
+    }
+    std::cout << "Streaming render, block size " << blockSize << " samples\n";
+    while (next < order.size() || !active.empty())
+    {
+        const int64_t blockEnd = blockStart + blockSize;
+
+        // 激活在本窗口内开始的片段，多个片段并行打开、解码
+        std::vector<ActiveClip> arriving;
+        while (next < order.size() && clipStartSample(clips[order[next]], sampleRate) < blockEnd)
+        {
+            arriving.emplace_back();
+            arriving.back().index = order[next];
+            ++next;
         }
+        if (prefetcher)
+        {
+            prefetcher->advance(next);
+        }
+        std::vector<char> opened(arriving.size(), 0);
+        std::vector<double> lengths(arriving.size(), 0.0);
+        pool.parallelFor(arriving.size(), [&](size_t k) {
+            ProfileScope scope("open clip");
+            opened[k] = openActiveClip(clips[arriving[k].index], options, arriving[k], lengths[k]);
+        });
+
+        for (size_t k = 0; k < arriving.size(); ++k)
+        {
+            if (!opened[k])
+            {
+                continue;
+            }
+            ActiveClip& clipState = arriving[k];
+            const AudioClip& clip = clips[clipState.index];
+            const double lengthInSeconds = lengths[k];
+            placeActiveClip(clip, sampleRate, clipState);
+            std::printf("%s\t%.2fs vol:%.2f|%.2fs->%.2fs\n", clip.filename.c_str(), lengthInSeconds, clip.volume, clip.startTime, clip.startTime + lengthInSeconds);
 
-        output.push_back(sample);
+            auto pos = std::lower_bound(active.begin(), active.end(), clipState.index,
+                [](const ActiveClip& a, size_t index) { return a.index < index; });
+            active.insert(pos, std::move(clipState));
+        }
+
+        std::fill(left.begin(), left.end(), 0.0f);
+        std::fill(right.begin(), right.end(), 0.0f);
+        mixClipsTiled(pool, active, clips, left.data(), right.data(), blockStart, blockEnd);
+
+        if (limited)
+        {
+            if (!limited->write(left.data(), right.data(), blockSize))
+            {
+                std::cerr << "Failed to save: " << outputFile << "\n";
+                return 1;
+            }
+            active.erase(std::remove_if(active.begin(), active.end(),
+                [blockEnd](const ActiveClip& a) { return a.endSample <= blockEnd; }), active.end());
+            blockStart = blockEnd;
+            continue;
+        }
+
+        for (int i = 0; i < blockSize; ++i)
+        {
+            maxVal = std::max(maxVal, std::abs(left[i]));
+            maxVal = std::max(maxVal, std::abs(right[i]));
+            if (left[i] != 0 || right[i] != 0)
+            {
+                lastNonZero = blockStart + i;
+            }
+            interleaved[2 * i] = left[i];
+            interleaved[2 * i + 1] = right[i];
+        }
+        {
+            ProfileScope scope("write temp");
+            temp.write(reinterpret_cast<const char*>(interleaved.data()), interleaved.size() * sizeof(float));
+        }
+        if (!temp.good())
+        {
+            std::cerr << "Failed to write temporary file: " << tempFile << "\n";
+            temp.close();
+            std::remove(tempFile.c_str());
+            return 1;
+        }
+
+        // 释放已经结束的片段
+        active.erase(std::remove_if(active.begin(), active.end(),
+            [blockEnd](const ActiveClip& a) { return a.endSample <= blockEnd; }), active.end());
+        blockStart = blockEnd;
     }
+    if (limited)
+    {
+        if (limited->finish() && writer.close())
+        {
+            std::cout << "Limiter min gain " << limited->limiter.getMinGain() << "\n";
+            std::cout << "Saved to " << outputFile << " ("
+                << limited->written / sampleRate << " seconds)\n";
+            return 0;
+        }
+        std::cerr << "Failed to save: " << outputFile << "\n";
+        return 1;
+    }
+    temp.close();
 
-    input = std::move(output);
-    return true;
+    // 裁剪末尾静音 + 归一化，逐块写出
+    ProfileScope finalizeScope("finalize", true);
+    const int64_t totalSamples = lastNonZero + 1;
+    float gain = 1.0f;
+    if (maxVal > 1.0f) {
+        gain = 1.0f / maxVal;
+        std::cout << "Normalized audio (max = " << maxVal << ") -> gain = " << gain << "\n";
+    }
+
+    std::ifstream input(tempFile, std::ios::binary);
+    bool ok = input.is_open() && writer.open(outputFile, sampleRate, 2, 16);
+    for (int64_t pos = 0; ok && pos < totalSamples; pos += blockSize)
+    {
+        const int n = static_cast<int>(std::min<int64_t>(blockSize, totalSamples - pos));
+        const std::streamsize bytes = static_cast<std::streamsize>(n) * 2 * static_cast<std::streamsize>(sizeof(float));
+        input.read(reinterpret_cast<char*>(interleaved.data()), bytes);
+        if (input.gcount() != bytes)
+        {
+            ok = false;
+            break;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            left[i] = interleaved[2 * i];
+            right[i] = interleaved[2 * i + 1];
+            if (maxVal > 1.0f)
+            {
+                left[i] *= gain;
+                right[i] *= gain;
+            }
+        }
+        const float* channels[] = { left.data(), right.data() };
+        ok = writer.write(channels, n);
+    }
+    input.close();
+    std::remove(tempFile.c_str());
+
+    if (ok && writer.close()) {
+        std::cout << "Saved to " << outputFile << " ("
+            << totalSamples / sampleRate << " seconds)\n";
+        return 0;
+    }
+    std::cerr << "Failed to save: " << outputFile << "\n";
+    return 1;
 }
 
+// 增量渲染（--incremental）的清单，保存在 <输出>.manifest 中。时间线按 blockSize 切成块，
+// 每块记录参与混音的片段（文件、修改时间、位置、音量）的哈希、峰值和最后一个非零采样；
+// 归一化之前的混音结果按块保存在 <输出>.tiles 中，下次只需重新混音哈希变了的块
+struct RenderManifest {
+    static constexpr uint32_t version = 1;
 
-static void resizeAudioBuffer(float*& buffer1, float*& buffer2, int& bufferSize, const int& newBufferSize)
+    struct Tile {
+        uint64_t hash = 0;
+        float peak = 0.0f;
+        int64_t lastNonZero = -1;
+    };
+
+    int sampleRate = 0;
+    int resampleQuality = 0;
+    int tileSize = 0;
+    bool dither = false;
+    std::vector<Tile> tiles;
+
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t header[6] = {};
+        uint64_t numTiles = 0;
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        file.read(reinterpret_cast<char*>(&numTiles), sizeof(numTiles));
+        if (!file || std::memcmp(header, "WCIM", 4) != 0 || header[1] != version)
+        {
+            return false;
+        }
+        sampleRate = static_cast<int>(header[2]);
+        resampleQuality = static_cast<int>(header[3]);
+        tileSize = static_cast<int>(header[4]);
+        dither = header[5] != 0;
+        tiles.resize(static_cast<size_t>(numTiles));
+        for (Tile& tile : tiles)
+        {
+            file.read(reinterpret_cast<char*>(&tile.hash), sizeof(tile.hash));
+            file.read(reinterpret_cast<char*>(&tile.peak), sizeof(tile.peak));
+            file.read(reinterpret_cast<char*>(&tile.lastNonZero), sizeof(tile.lastNonZero));
+        }
+        return static_cast<bool>(file);
+    }
+
+    bool save(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        uint32_t header[6] = { 0, version, static_cast<uint32_t>(sampleRate), static_cast<uint32_t>(resampleQuality),
+            static_cast<uint32_t>(tileSize), dither ? 1u : 0u };
+        std::memcpy(header, "WCIM", 4);
+        const uint64_t numTiles = tiles.size();
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&numTiles), sizeof(numTiles));
+        for (const Tile& tile : tiles)
+        {
+            file.write(reinterpret_cast<const char*>(&tile.hash), sizeof(tile.hash));
+            file.write(reinterpret_cast<const char*>(&tile.peak), sizeof(tile.peak));
+            file.write(reinterpret_cast<const char*>(&tile.lastNonZero), sizeof(tile.lastNonZero));
+        }
+        return static_cast<bool>(file);
+    }
+
+    // 所有块合起来的峰值和有效长度（裁掉末尾静音）
+    float peak() const
+    {
+        float maxVal = 0.0f;
+        for (const Tile& tile : tiles)
+        {
+            maxVal = std::max(maxVal, tile.peak);
+        }
+        return maxVal;
+    }
+
+    int64_t totalSamples() const
+    {
+        int64_t lastNonZero = -1;
+        for (const Tile& tile : tiles)
+        {
+            lastNonZero = std::max(lastNonZero, tile.lastNonZero);
+        }
+        return lastNonZero + 1;
+    }
+};
+
+// 每块单独设定抖动的种子，只重写某一块时得到的噪声与整段写出时相同
+static uint32_t tileDitherSeed(size_t tile)
+{
+    return 0x9E3779B9u ^ static_cast<uint32_t>(tile * 0x85EBCA6Bu);
+}
+
+// 增量渲染：只重新混音输入有变化的块。峰值和长度不变时只改写输出 wav 中这些块对应的字节，
+// 否则用保存的混音结果重新写出整个 wav（仍然不需要重新解码、混音没变的块）
+static int renderIncremental(const std::vector<AudioClip>& clips, const RenderOptions& options)
 {
-    std::printf("Resizing...\n");
+    const int sampleRate = options.sampleRate;
+    const std::string& outputFile = options.outputFile;
+    const int tileSize = options.blockSize;
+    const std::string manifestFile = outputFile + ".manifest";
+    const std::string tilesFile = outputFile + ".tiles";
+    const size_t tileBytes = static_cast<size_t>(tileSize) * 2 * sizeof(float);
+    ThreadPool pool(options.jobs);
+
+    // 片段的范围和指纹（文件内容变化通过大小和修改时间发现）
+    std::vector<int64_t> starts(clips.size(), 0), ends(clips.size(), 0);
+    std::vector<uint64_t> fingerprints(clips.size(), 0);
+    pool.parallelFor(clips.size(), [&](size_t i) {
+        ProfileScope scope("fingerprint");
+        const AudioClip& clip = clips[i];
+        if (!probeClipRange(clip, sampleRate, starts[i], ends[i]))
+        {
+            starts[i] = ends[i] = 0;
+            return;
+        }
+        std::error_code error;
+        const int64_t size = static_cast<int64_t>(std::filesystem::file_size(clip.filename, error));
+        const auto modified = std::filesystem::last_write_time(clip.filename, error);
+        const int64_t fields[] = { size, static_cast<int64_t>(modified.time_since_epoch().count()), starts[i], ends[i] };
+        uint64_t h = hashBytes(clip.filename.data(), clip.filename.size());
+        h = hashBytes(fields, sizeof(fields), h);
+        if (clip.isSlice())
+        {
+            // 没有截取的片段指纹不变，已有的清单仍然有效
+            const double range[] = { clip.offset, clip.length };
+            h = hashBytes(range, sizeof(range), h);
+        }
+        if (clip.repeat != 1)
+        {
+            const double pattern[] = { static_cast<double>(clip.repeat), clip.period };
+            h = hashBytes(pattern, sizeof(pattern), h);
+        }
+        fingerprints[i] = hashBytes(&clip.volume, sizeof(clip.volume), h);
+    });
+
+    // 每块的哈希按输入顺序合并参与的片段，顺序变化也会让块重新混音（累加顺序影响结果）
+    int64_t timelineEnd = 0;
+    for (size_t i = 0; i < clips.size(); ++i)
+    {
+        timelineEnd = std::max(timelineEnd, ends[i]);
+    }
+    RenderManifest manifest;
+    manifest.sampleRate = sampleRate;
+    manifest.resampleQuality = static_cast<int>(options.resampleQuality);
+    manifest.tileSize = tileSize;
+    manifest.dither = options.dither;
+    manifest.tiles.resize(static_cast<size_t>((timelineEnd + tileSize - 1) / tileSize));
+    for (size_t i = 0; i < clips.size(); ++i)
+    {
+        if (starts[i] >= ends[i])
+        {
+            continue;
+        }
+        for (int64_t t = starts[i] / tileSize; t <= (ends[i] - 1) / tileSize; ++t)
+        {
+            uint64_t& hash = manifest.tiles[static_cast<size_t>(t)].hash;
+            hash = hashBytes(&fingerprints[i], sizeof(fingerprints[i]), hash);
+        }
+    }
 
-    if (bufferSize > newBufferSize)
+    RenderManifest previous;
+    std::error_code error;
+    const bool compatible = previous.load(manifestFile) && previous.sampleRate == sampleRate
+        && previous.resampleQuality == manifest.resampleQuality && previous.tileSize == tileSize
+        && std::filesystem::file_size(tilesFile, error) == previous.tiles.size() * tileBytes && !error;
+    std::vector<size_t> dirty;
+    for (size_t t = 0; t < manifest.tiles.size(); ++t)
     {
-        std::cerr << "Error: Current size (" << bufferSize
-            << ") is larger than new size (" << newBufferSize << ")\n";
-        return;
+        if (compatible && t < previous.tiles.size() && previous.tiles[t].hash == manifest.tiles[t].hash)
+        {
+            manifest.tiles[t].peak = previous.tiles[t].peak;
+            manifest.tiles[t].lastNonZero = previous.tiles[t].lastNonZero;
+        }
+        else
+        {
+            dirty.push_back(t);
+        }
     }
+    std::cout << "Incremental render: " << dirty.size() << " of " << manifest.tiles.size() << " blocks changed\n";
+
+    // 清单最后再写，中途失败时下次会把这些块重新算一遍
+    std::remove(manifestFile.c_str());
+    if (!compatible)
+    {
+        std::ofstream(tilesFile, std::ios::binary | std::ios::trunc);
+    }
+    std::filesystem::resize_file(tilesFile, manifest.tiles.size() * tileBytes, error);
+    std::fstream tiles(tilesFile, std::ios::binary | std::ios::in | std::ios::out);
+    if (error || !tiles.is_open())
+    {
+        std::cerr << "Cannot open block file: " << tilesFile << "\n";
+        return 1;
+    }
+
+    // 每次处理一批变化的块（约 4M 个采样）：只打开与这批块重叠的片段，各块并行混音
+    const size_t batchTiles = std::max<size_t>(1, (size_t(1) << 22) / tileSize);
+    std::vector<float> mixed(batchTiles * tileSize * 2);
+    for (size_t first = 0; first < dirty.size(); first += batchTiles)
+    {
+        const size_t count = std::min(batchTiles, dirty.size() - first);
+        std::vector<ActiveClip> active;
+        for (size_t i = 0; i < clips.size(); ++i)
+        {
+            for (size_t k = first; k < first + count; ++k)
+            {
+                const int64_t tileStart = static_cast<int64_t>(dirty[k]) * tileSize;
+                if (starts[i] < tileStart + tileSize && ends[i] > tileStart)
+                {
+                    active.emplace_back();
+                    active.back().index = i;
+                    break;
+                }
+            }
+        }
+        std::vector<char> opened(active.size(), 0);
+        pool.parallelFor(active.size(), [&](size_t k) {
+            ProfileScope scope("open clip");
+            ActiveClip& clipState = active[k];
+            double lengthInSeconds = 0.0;
+            opened[k] = openActiveClip(clips[clipState.index], options, clipState, lengthInSeconds);
+            if (opened[k])
+            {
+                placeActiveClip(clips[clipState.index], sampleRate, clipState);
+            }
+        });
+        for (size_t k = 0; k < active.size(); ++k)
+        {
+            if (!opened[k])
+            {
+                active[k].startSample = active[k].endSample = 0;
+            }
+        }
 
-    // 分配新缓冲区
-    float* newBuffer1 = new float[newBufferSize];
-    float* newBuffer2 = new float[newBufferSize];
+        pool.parallelFor(count, [&](size_t k) {
+            ProfileScope scope("mix tile");
+            const size_t tile = dirty[first + k];
+            const int64_t tileStart = static_cast<int64_t>(tile) * tileSize;
+            std::vector<float> left(tileSize, 0.0f), right(tileSize, 0.0f);
+            std::vector<std::vector<float>> scratch;
+            for (const ActiveClip& clipState : active)
+            {
+                mixClipIntoBlock(clipState, clips[clipState.index].volume, left.data(), right.data(), tileStart, tileSize, scratch);
+            }
+            RenderManifest::Tile& state = manifest.tiles[tile];
+            float* interleaved = mixed.data() + k * tileSize * 2;
+            state.peak = 0.0f;
+            state.lastNonZero = -1;
+            for (int i = 0; i < tileSize; ++i)
+            {
+                state.peak = std::max(state.peak, std::abs(left[i]));
+                state.peak = std::max(state.peak, std::abs(right[i]));
+                if (left[i] != 0 || right[i] != 0)
+                {
+                    state.lastNonZero = tileStart + i;
+                }
+                interleaved[2 * i] = left[i];
+                interleaved[2 * i + 1] = right[i];
+            }
+        });
 
-    // 复制旧数据
-    std::memcpy(newBuffer1, buffer1, bufferSize * sizeof(float));
-    std::memcpy(newBuffer2, buffer2, bufferSize * sizeof(float));
+        ProfileScope writeScope("write blocks", true);
+        for (size_t k = 0; k < count; ++k)
+        {
+            tiles.seekp(static_cast<std::streamoff>(dirty[first + k] * tileBytes));
+            tiles.write(reinterpret_cast<const char*>(mixed.data() + k * tileSize * 2), static_cast<std::streamsize>(tileBytes));
+        }
+        if (!tiles.good())
+        {
+            std::cerr << "Failed to write block file: " << tilesFile << "\n";
+            return 1;
+        }
+    }
 
-    // 将新增部分清零
-    std::memset(newBuffer1 + bufferSize, 0, (newBufferSize - bufferSize) * sizeof(float));
-    std::memset(newBuffer2 + bufferSize, 0, (newBufferSize - bufferSize) * sizeof(float));
+    // 裁剪末尾静音 + 归一化
+    ProfileScope finalizeScope("finalize", true);
+    const float maxVal = manifest.peak();
+    const int64_t totalSamples = manifest.totalSamples();
+    float gain = 1.0f;
+    if (maxVal > 1.0f) {
+        gain = 1.0f / maxVal;
+        std::cout << "Normalized audio (max = " << maxVal << ") -> gain = " << gain << "\n";
+    }
 
-    // 释放旧缓冲区
-    delete[] buffer1;
-    delete[] buffer2;
+    // 读出一块保存的混音结果并乘上增益
+    std::vector<float> left(tileSize), right(tileSize), interleaved(static_cast<size_t>(tileSize) * 2);
+    auto readTile = [&](size_t tile, int n) {
+        tiles.seekg(static_cast<std::streamoff>(tile * tileBytes));
+        tiles.read(reinterpret_cast<char*>(interleaved.data()), static_cast<std::streamsize>(n) * 2 * sizeof(float));
+        for (int i = 0; i < n; ++i)
+        {
+            left[i] = interleaved[2 * i];
+            right[i] = interleaved[2 * i + 1];
+            if (maxVal > 1.0f)
+            {
+                left[i] *= gain;
+                right[i] *= gain;
+            }
+        }
+        return static_cast<bool>(tiles);
+    };
 
-    // 更新指针（通过引用，外部也会更新）
-    buffer1 = newBuffer1;
-    buffer2 = newBuffer2;
+    // 峰值、长度、抖动设置都没变，并且输出文件还是上次写出的样子时，只改写变化的块
+    size_t dataOffset = 0;
+    bool patch = false;
+    if (compatible && previous.dither == options.dither && previous.peak() == maxVal && previous.totalSamples() == totalSamples)
+    {
+        AudioFileReader<float> existing;
+        existing.shouldLogErrorsToConsole(false);
+        patch = existing.open(outputFile) && existing.getAudioFileFormat() == AudioFileFormat::Wave
+            && existing.getNumChannels() == 2 && existing.getBitDepth() == 16
+            && static_cast<int>(existing.getSampleRate()) == sampleRate && existing.getNumSamplesPerChannel() == totalSamples;
+        dataOffset = existing.getSampleDataOffset();
+    }
 
-    // 更新大小
-    bufferSize = newBufferSize;
+    bool ok = true;
+    if (patch)
+    {
+        std::fstream output(outputFile, std::ios::binary | std::ios::in | std::ios::out);
+        std::vector<uint8_t> encoded(static_cast<size_t>(tileSize) * 2 * sizeof(int16_t));
+        size_t patched = 0;
+        for (size_t tile : dirty)
+        {
+            const int64_t tileStart = static_cast<int64_t>(tile) * tileSize;
+            if (tileStart >= totalSamples)
+            {
+                continue;
+            }
+            const int n = static_cast<int>(std::min<int64_t>(tileSize, totalSamples - tileStart));
+            ok = ok && readTile(tile, n);
+            const float* channels[] = { left.data(), right.data() };
+            TpdfDither dither(tileDitherSeed(tile));
+            AudioSampleKernels<float>::encode(channels, 2, n, SampleEncoding::Int16, false, encoded.data(), options.dither ? &dither : nullptr);
+            output.seekp(static_cast<std::streamoff>(dataOffset + static_cast<size_t>(tileStart) * 2 * sizeof(int16_t)));
+            output.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(n) * 2 * sizeof(int16_t));
+            ++patched;
+        }
+        ok = ok && output.good();
+        std::cout << "Patched " << patched << " blocks in place\n";
+    }
+    else
+    {
+        AudioFileWriter<float> writer;
+        writer.setDither(options.dither);
+        ok = writer.open(outputFile, sampleRate, 2, 16);
+        for (int64_t pos = 0; ok && pos < totalSamples; pos += tileSize)
+        {
+            const size_t tile = static_cast<size_t>(pos / tileSize);
+            const int n = static_cast<int>(std::min<int64_t>(tileSize, totalSamples - pos));
+            ok = readTile(tile, n);
+            const float* channels[] = { left.data(), right.data() };
+            writer.setDitherSeed(tileDitherSeed(tile));
+            ok = ok && writer.write(channels, n);
+        }
+        ok = writer.close() && ok;
+    }
+    tiles.close();
 
+    if (ok && manifest.save(manifestFile)) {
+        std::cout << "Saved to " << outputFile << " ("
+            << totalSamples / sampleRate << " seconds)\n";
+        return 0;
+    }
+    std::cerr << "Failed to save: " << outputFile << "\n";
+    return 1;
 }
-struct AudioClip {
-    std::string filename="";
-    float startTime=0.0f;
-    float volume=.0f;
+
+// 批量渲染中的一个任务
+struct BatchJob {
+    std::string clipList;
+    std::string output;
 };
 
-float safeStof(const std::string& str) {
-    try {
-        return std::stof(str);
+// 读取 --batch 的清单：每行一个任务 "<片段列表> <输出 wav>"，两者用制表符分隔，没有制表符时以最后一段空白分隔。
+// 空行和 # 开头的行被忽略
+static bool parseBatchManifest(const std::string& path, std::vector<BatchJob>& jobs)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Cannot open file: " << path << "\n";
+        return false;
     }
-    catch (...) {
-        throw std::runtime_error("Invalid number: " + str);
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+    {
+        if (lineNumber == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        {
+            line.erase(0, 3);
+        }
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+        {
+            line.pop_back();
+        }
+        const size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+        {
+            continue;
+        }
+        size_t split = line.find('\t', first);
+        if (split == std::string::npos)
+        {
+            split = line.find_last_of(' ');
+        }
+        const size_t outputStart = split == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", split);
+        if (split == std::string::npos || split < first || outputStart == std::string::npos)
+        {
+            std::cerr << path << ":" << lineNumber << ": expected <clip list> <output wav>\n";
+            return false;
+        }
+        std::string clipList = line.substr(first, split - first);
+        while (!clipList.empty() && std::isspace(static_cast<unsigned char>(clipList.back())))
+        {
+            clipList.pop_back();
+        }
+        jobs.push_back({ clipList, line.substr(outputStart) });
     }
+    return true;
 }
 
-std::vector<struct AudioClip> parseInputFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::printf("Cannot open file: %s\n", filename.c_str());
-        throw std::runtime_error("Cannot open file");
+// 批量渲染：一次运行渲染多个片段列表。所有任务共用一个线程池和音源缓存（上限同 --cache-budget），
+// 同一个音源在整批中只解码、重采样一次；最多 -j 个任务同时渲染，各任务的解码和混音都交给共用的线程池
+static int renderBatch(const std::vector<BatchJob>& jobs, const RenderOptions& options)
+{
+    // 两个任务写同一个文件会同时写坏它，开始之前就拒绝。路径先规范化，a.wav 和 ./a.wav 算同一个文件
+    std::map<std::string, size_t> outputs;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        std::error_code error;
+        std::filesystem::path output = std::filesystem::weakly_canonical(jobs[i].output, error);
+        if (error)
+        {
+            output = std::filesystem::absolute(jobs[i].output).lexically_normal();
+        }
+        const auto inserted = outputs.emplace(output.string(), i);
+        if (!inserted.second)
+        {
+            std::cerr << jobs[inserted.first->second].clipList << " and " << jobs[i].clipList << " both write " << jobs[i].output << "\n";
+            return 1;
+        }
     }
 
-    std::vector<std::string> tokens;
-    std::string line;
-    std::printf("reading:%s\n", filename.c_str());
+    ThreadPool pool(options.jobs);
+    SourceCache sources(options.cacheBudget);
+    RenderOptions jobOptions = options;
+    jobOptions.verbose = false;
 
+    std::atomic<size_t> next{ 0 };
+    std::mutex printMutex;
+    size_t finished = 0;
+    size_t failed = 0;
+    auto runJobs = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < jobs.size())
+        {
+            const BatchJob& job = jobs[i];
+            std::string error;
+            size_t numClips = 0;
+            int64_t numSamples = 0;
+            try
+            {
+                const std::vector<AudioClip> clips = ClipList::load(job.clipList, 1);
+                numClips = clips.size();
+                if (clips.empty())
+                {
+                    error = "no valid clips found";
+                }
+                else
+                {
+                    Compositor compositor(jobOptions, pool, sources);
+                    WavFileSink sink(job.output, options.dither);
+                    if (!compositor.render(clips, sink))
+                    {
+                        error = "failed to save " + job.output;
+                    }
+                    numSamples = sink.getNumSamples();
+                }
+            }
+            catch (const std::exception& e)
+            {
+                error = e.what();
+            }
 
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string token;
-        while (iss >> token) {
-            tokens.push_back(token);
+            std::lock_guard<std::mutex> lock(printMutex);
+            ++finished;
+            if (error.empty())
+            {
+                std::printf("[%zu/%zu] %s -> %s (%zu clips, %.2f seconds)\n", finished, jobs.size(), job.clipList.c_str(), job.output.c_str(),
+                    numClips, static_cast<double>(numSamples) / options.sampleRate);
+            }
+            else
+            {
+                ++failed;
+                std::printf("[%zu/%zu] %s: %s\n", finished, jobs.size(), job.clipList.c_str(), error.c_str());
+            }
         }
-    }
+    };
 
-    if (tokens.size() % 3 != 0) {
-        throw std::runtime_error("Input file must contain groups of 3: <wavfile> <starttime> <volume>");
+    std::vector<std::thread> runners;
+    const size_t numRunners = std::min<size_t>(jobs.size(), static_cast<size_t>(options.jobs));
+    for (size_t r = 0; r < numRunners; ++r)
+    {
+        runners.emplace_back(runJobs);
     }
+    for (std::thread& runner : runners)
+    {
+        runner.join();
+    }
+    std::printf("Rendered %zu of %zu lists, %zu sources resident (%lld MiB)\n", jobs.size() - failed, jobs.size(), sources.size(),
+        static_cast<long long>(sources.getResidentBytes() / 1048576));
+    return failed == 0 ? 0 : 1;
+}
 
-    std::vector<struct AudioClip> clips;
-    std::printf("File name\tVolume|Start time\n");
-    for (size_t i = 0; i < tokens.size(); i += 3) {
-        struct AudioClip clip;
-        clip.filename = tokens[i];
-        clip.startTime = safeStof(tokens[i + 1]);
-        clip.volume = safeStof(tokens[i + 2]);
+// --dry-run：只读各片段的文件头，报告时间线长度和整段渲染需要的内存，不解码、不混音
+static int reportDryRun(const std::vector<AudioClip>& clips, const RenderOptions& options)
+{
+    const int sampleRate = options.sampleRate;
+    std::vector<AudioFileInfo> infos(clips.size());
+    std::vector<char> probed(clips.size(), 0);
+    ThreadPool pool(options.jobs);
+    pool.parallelFor(clips.size(), [&](size_t i) {
+        probed[i] = probeClip(clips[i], sampleRate, infos[i]);
+    });
 
-        if (clip.startTime < 0) {
-            clip.startTime = 0;
-        }
-        if (clip.volume < 0) {
-            clip.volume = 0;
+    int64_t timelineEnd = 0;
+    int64_t sourceBytes = 0;
+    size_t failed = 0;
+    std::map<std::string, int64_t> sources;
+    for (size_t i = 0; i < clips.size(); ++i)
+    {
+        if (!probed[i])
+        {
+            std::printf("Failed to probe %s\n", clips[i].filename.c_str());
+            ++failed;
+            continue;
         }
-
-        std::printf("%s\t%.2f|%.2f\n", clip.filename.c_str(), clip.volume, clip.startTime);
-        clips.push_back(clip);
+        int64_t startSample = 0, endSample = 0;
+        clipSampleRange(clips[i], infos[i].numSamplesPerChannel, sampleRate, startSample, endSample);
+        timelineEnd = std::max(timelineEnd, endSample);
+        sources[clips[i].filename] = infos[i].numChannels * infos[i].numSamplesPerChannel * static_cast<int64_t>(sizeof(float));
+    }
+    for (const auto& source : sources)
+    {
+        sourceBytes += source.second;
     }
 
-    return clips;
+    const double MiB = 1048576.0;
+    std::printf("Clips: %zu (%zu failed), unique sources: %zu\n", clips.size(), failed, sources.size());
+    std::printf("Timeline: %lld samples (%.2f seconds at %d Hz)\n", static_cast<long long>(timelineEnd),
+        static_cast<double>(timelineEnd) / sampleRate, sampleRate);
+    std::printf("Mix buffer: %.1f MiB, decoded sources: %.1f MiB\n", timelineEnd * 2 * sizeof(float) / MiB, sourceBytes / MiB);
+    std::printf("Output: up to %.1f MiB (16-bit stereo)\n", timelineEnd * 2 * sizeof(int16_t) / MiB);
+    return failed == 0 ? 0 : 1;
 }
 
+// 退出 main 时输出剖析结果。在渲染之前构造，析构时渲染用的线程池都已结束
+struct ProfileReport {
+    const RenderOptions& options;
+
+    ~ProfileReport()
+    {
+        if (!options.profile)
+        {
+            return;
+        }
+        Profiler::instance().printSummary();
+        if (!options.profileTrace.empty())
+        {
+            if (Profiler::instance().writeTrace(options.profileTrace))
+            {
+                std::printf("Trace written to %s\n", options.profileTrace.c_str());
+            }
+            else
+            {
+                std::printf("Failed to write trace %s\n", options.profileTrace.c_str());
+            }
+        }
+    }
+};
+
 inline static void showHelp(char* argv0)
 {
-    std::cerr << "Usage: " << argv0 << " <input.txt> [-o output.wav] [-s <sample rate> default:44100]\n";
+    std::cerr << "Usage: " << argv0 << " <input.txt> [more inputs...] [-o output.wav] [-s <sample rate> default:44100] [--stream] [--block <samples> default:65536] [--dither] [-j <threads>] [--resample-quality fast|medium|best] [--cache-dir <dir>] [--incremental] [--dry-run] [--limiter] [--save-clip-list <file>] [--profile] [--profile-trace <file>] [--prefetch <clips>] [--batch <manifest>] [--serve <socket>] [--cache-budget <MiB>] [--max-jobs <n>]\n";
     std::printf("Input file must contain groups of 3: <wavfile> <starttime> <volume>\n.");
+    std::printf("A group may be followed by offset=<seconds> and length=<seconds> to use only that part of the source.\n");
+    std::printf("repeat=<count> and period=<seconds> place the clip count times, period seconds apart, from one decoded source (period must be > 0 when count > 1).\n");
+    std::printf("The input file may also be a binary clip list written by --save-clip-list.\n");
+    std::printf("--stream renders the timeline block by block, so memory use does not grow with its length.\n");
+    std::printf("--dither adds TPDF dither when quantizing the output to 16 bits.\n");
+    std::printf("-j <threads> decodes and resamples clips on this many threads (default: all cores).\n");
+    std::printf("--resample-quality fast uses linear interpolation, medium (default) and best use a windowed-sinc polyphase filter.\n");
+    std::printf("--cache-dir <dir> keeps decoded and resampled sources in <dir> so later runs skip decoding them.\n");
+    std::printf("--incremental remembers the previous render and only re-mixes the blocks whose clips changed.\n");
+    std::printf("--dry-run reads only the file headers and reports the timeline length and the memory a render needs.\n");
+    std::printf("--save-clip-list <file> converts the input list to the binary clip-list format and exits.\n");
+    std::printf("--profile prints the time, call count and peak memory of each stage plus I/O counters when the render ends.\n");
+    std::printf("--profile-trace <file> also writes a Chrome trace-event file (chrome://tracing, Perfetto) showing per-thread activity.\n");
+    std::printf("--prefetch <clips> reads the files of this many upcoming clips ahead of decoding (io_uring on Linux, background threads elsewhere; default: 32, 0 disables).\n");
+    std::printf("Several input files, or --batch <manifest> with one \"<clip list> <output.wav>\" pair per line, render many lists in one run; each source is decoded once for the whole batch.\n");
+    std::printf("--serve <socket> keeps running and renders clip lists sent to a Unix domain socket; the first line of each request is the output path (- returns the wav over the socket).\n");
+    std::printf("--cache-budget <MiB> limits the decoded sources --serve and batch mode keep in memory (default: 2048).\n");
+    std::printf("--max-jobs <n> limits how many --serve requests render at once; further connections wait (default: 4).\n");
+    std::printf("--limiter replaces the global normalization with a lookahead peak limiter and writes the output block by block (implies --stream).\n");
 }
 int main(int argc, char* argv[]) {
 #ifdef _WIN32
-    system("chcp 65001 > nul");
+    SetConsoleOutputCP(CP_UTF8);
 #endif
     std::cout << "wavCompositorExtended2.0\n";
-    int sampleRate = 44100;
+    RenderOptions options;
     if (argc < 2) {
         showHelp(argv[0]);
         return -1;
     }
 
-    std::string txtFile = argv[1];
-    std::string outputFile = "result.wav";
+    std::vector<std::string> inputFiles;
+    std::string batchManifest;
+    bool outputGiven = false;
 
-    for (int i = 1; i < argc - 1; ++i) {
+    for (int i = 1; i < argc; ++i) {
         const std::string arg = argv[i];
         if (arg == "-h") {
             showHelp(argv[0]);
@@ -185,193 +936,256 @@ int main(int argc, char* argv[]) {
                 return -1;
 
             }
-            outputFile = argv[i + 1];
+            options.outputFile = argv[++i];
+            outputGiven = true;
         }
         else if (arg == "-s") {
-            int sr = std::stoi(argv[i + 1]);
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your sample rate?!\n";
+                return -1;
+            }
+            int sr = std::stoi(argv[++i]);
             if (sr <= 0 || sr > 384000) {
                 std::cerr << "Invalid sample rate: " << sr << ". Must be 1~384000 Hz.\n";
                 return 1;
             }
-            sampleRate = sr;
+            options.sampleRate = sr;
         }
-    }
-
-    //try {
-        std::vector<struct AudioClip> clips = parseInputFile(txtFile);
-        if (clips.empty()) {
-            std::cerr << "No valid clips found.\n";
-            return 1;
+        else if (arg == "--stream") {
+            options.streamMode = true;
         }
-
-        size_t maxEndSample = 0;
-        std::vector<AudioFile<float>> audioFiles;
-        audioFiles.reserve(clips.size());
-
-        std::cout << "Loading and resampling audio files...\n";
-        int maxDuration = 0;
-        for (const AudioClip& clip : clips)
-        {
-            maxDuration = std::max(maxDuration, static_cast<int>(clip.startTime));
+        else if (arg == "--dry-run") {
+            options.dryRun = true;
         }
-        //std::vector<std::vector<float>> buffer(2, std::vector<float>(maxDuration*sampleRate,.0f));
-        int bufferSize = maxDuration * sampleRate;
-        //int bufferSize = 24;
-        float* buffer1 = new float[bufferSize];
-        float* buffer2 = new float[bufferSize];
-        float* buffer[] = { buffer1,buffer2 };
-        std::memset(buffer1, 0, bufferSize * sizeof(float));
-        std::memset(buffer2, 0, bufferSize * sizeof(float));
-
-        for (const AudioClip& clip : clips)
-        {
-            AudioFile<float> audio;
-            if (!audio.load(clip.filename))
+        else if (arg == "--incremental") {
+            options.incremental = true;
+        }
+        else if (arg == "--dither") {
+            options.dither = true;
+        }
+        else if (arg == "--limiter") {
+            options.limiter = true;
+        }
+        else if (arg == "--profile") {
+            options.profile = true;
+        }
+        else if (arg == "--profile-trace") {
+            if (i + 1 >= argc)
             {
-                std::printf("Failed to load %s\n", clip.filename.c_str());
-                continue;
+                std::cerr << "Where is your trace file?!\n";
+                return -1;
             }
-            const int originalSampleRate = audio.getSampleRate();
-
-          
-            if (originalSampleRate != sampleRate)
+            options.profile = true;
+            options.profileTrace = argv[++i];
+        }
+        else if (arg == "--batch") {
+            if (i + 1 >= argc)
             {
-                std::printf("resampling.\n");
-                for (int ch = 0; ch < audio.getNumChannels(); ++ch)
-                {
-                    resampleAudio(audio.samples[ch], originalSampleRate, sampleRate);
-                }
-                audio.setSampleRate(sampleRate); // 更新元数据
-            }
-            const float startTime = clip.startTime;
-            float endTime = clip.startTime + audio.getLengthInSeconds();
-            int startSampleinBuffer = static_cast<int>(std::round(startTime * sampleRate));
-            int endSampleinBuffer = std::floor(endTime * sampleRate);
-            std::printf("%s\t%.2fs vol:%.2f|%.2fs->%.2fs\n",clip.filename.c_str(), static_cast<float>(audio.getLengthInSeconds()), clip.volume, startTime, endTime);
-            if (endSampleinBuffer > bufferSize)
+                std::cerr << "Where is your batch manifest?!\n";
+                return -1;
+            }
+            batchManifest = argv[++i];
+        }
+        else if (arg == "--prefetch") {
+            if (i + 1 >= argc)
             {
-                int newBufferSize = endSampleinBuffer;
-                std::printf("Resize buffer to %d(%d MiB)\n", newBufferSize, static_cast<int>(newBufferSize * sizeof(float) * 2) / 1048576);
-   
-
-
-                resizeAudioBuffer(buffer1, buffer2, bufferSize, newBufferSize);
-                buffer[0] = buffer1;
-                buffer[1] = buffer2;
+                std::cerr << "Where is your prefetch window?!\n";
+                return -1;
+            }
+            int window = std::stoi(argv[++i]);
+            if (window < 0 || window > 65536) {
+                std::cerr << "Invalid prefetch window: " << window << ". Must be 0~65536 clips.\n";
+                return 1;
             }
-            if (audio.getNumChannels() == 1)
+            options.prefetch = window;
+        }
+        else if (arg == "--serve") {
+            if (i + 1 >= argc)
             {
-                int count = 0;
-                for (int i = startSampleinBuffer; i < endSampleinBuffer; ++i, ++count)
-                {
-
-                    try
-                    {
-                        auto temp=audio.samples.at(0).at(count);
-                    }
-                    catch (const std::out_of_range& e)
-                    {
-                        std::cerr << " audio out of range\n" << e.what();
-                        break;
-                    }
-                    float sample = audio.samples.at(0).at(count) * clip.volume;
-                    while (i > bufferSize - 1)
-                    {
-                        resizeAudioBuffer(buffer1, buffer2, bufferSize, bufferSize * 2);
-                        buffer[0] = buffer1;
-                        buffer[1] = buffer2;
-                    }
-                     buffer[0][i] += sample;
-                     buffer[1][i] += sample;
-
-                    
-                }
-
+                std::cerr << "Where is your socket path?!\n";
+                return -1;
             }
-            else
+            options.serveSocket = argv[++i];
+        }
+        else if (arg == "--cache-budget") {
+            if (i + 1 >= argc)
             {
-                int count = 0;
-                for (int i = startSampleinBuffer; i < endSampleinBuffer; ++i, ++count)
-                {
-                    try
-                    {
-                        auto temp=audio.samples.at(0).at(count);
-                       temp= audio.samples.at(1).at(count);
-                    }
-                    catch (const std::out_of_range& e)
-
-                    {
-                        std::cerr << " audio out of range\n"<<e.what();
-                        break;
-                    }
-                    while (i > bufferSize - 1)
-                    {
-   
-
-
-                        resizeAudioBuffer(buffer1, buffer2, bufferSize, bufferSize * 2);  
-                        buffer[0] = buffer1;
-                        buffer[1] = buffer2;
-                    }
-                   buffer[0][i] += audio.samples.at(0).at(count) * clip.volume;
-                   buffer[1][i] += audio.samples.at(1).at(count) * clip.volume;
- 
-
-                }
-
-
-                    //assert(count == audio.getNumSamplesPerChannel());
+                std::cerr << "Where is your cache budget?!\n";
+                return -1;
             }
-
-
+            const long long budget = std::stoll(argv[++i]);
+            if (budget < 1 || budget > (1ll << 30)) {
+                std::cerr << "Invalid cache budget: " << budget << " MiB.\n";
+                return 1;
+            }
+            options.cacheBudget = static_cast<int64_t>(budget) << 20;
         }
-
-        ;
-        // 裁剪末尾静音
-        buffer[0] = buffer1;
-        buffer[1] = buffer2;
-        int lastNonZero = 0;
-        for (int i = bufferSize; i > 0; --i) {
-            if (buffer[0][i] == 0 && buffer[1][i] == 0) {
-                lastNonZero = i;
-                break;
+        else if (arg == "--max-jobs") {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your job limit?!\n";
+                return -1;
+            }
+            const int maxJobs = std::stoi(argv[++i]);
+            if (maxJobs < 1 || maxJobs > 256) {
+                std::cerr << "Invalid job limit: " << maxJobs << ". Must be 1~256.\n";
+                return 1;
             }
+            options.maxJobs = maxJobs;
         }
-        if (lastNonZero > 0) {
-            bufferSize = lastNonZero;
-            //buffer[0].resize(lastNonZero);
-            //buffer[1].resize(lastNonZero);
+        else if (arg == "--save-clip-list") {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your clip list file?!\n";
+                return -1;
+            }
+            options.saveClipList = argv[++i];
         }
-
-        // 归一化
-        float maxVal = 0.0f;
-        for (int i = 0; i < bufferSize;++i) {
-                
-            maxVal = std::max(maxVal, std::abs(buffer[0][i]));
-            maxVal = std::max(maxVal, std::abs(buffer[1][i]));
+        else if (arg == "-j") {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your thread count?!\n";
+                return -1;
+            }
+            int jobs = std::stoi(argv[++i]);
+            if (jobs < 1 || jobs > 1024) {
+                std::cerr << "Invalid thread count: " << jobs << ". Must be 1~1024.\n";
+                return 1;
+            }
+            options.jobs = jobs;
+        }
+        else if (arg == "--resample-quality") {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your resample quality?!\n";
+                return -1;
+            }
+            const std::string quality = argv[++i];
+            if (quality == "fast") {
+                options.resampleQuality = ResampleQuality::Fast;
+            }
+            else if (quality == "medium") {
+                options.resampleQuality = ResampleQuality::Medium;
+            }
+            else if (quality == "best") {
+                options.resampleQuality = ResampleQuality::Best;
+            }
+            else {
+                std::cerr << "Invalid resample quality: " << quality << ". Must be fast, medium or best.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--cache-dir") {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your cache directory?!\n";
+                return -1;
             }
-        if (maxVal > 1.0f) {
-            float gain = 1.0f / maxVal;
-            for (int i = 0; i < bufferSize; ++i) {
-                buffer[0][i] *= gain;
-                buffer[1][i] *= gain;   
+            options.cacheDir = argv[++i];
+            std::error_code error;
+            std::filesystem::create_directories(options.cacheDir, error);
+            if (error) {
+                std::cerr << "Cannot create cache directory: " << options.cacheDir << "\n";
+                return 1;
             }
-            std::cout << "Normalized audio (max = " << maxVal << ") -> gain = " << gain << "\n";
         }
+        else if (arg == "--block") {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Where is your block size?!\n";
+                return -1;
+            }
+            int bs = std::stoi(argv[++i]);
+            if (bs < 64 || bs > 16777216) {
+                std::cerr << "Invalid block size: " << bs << ". Must be 64~16777216 samples.\n";
+                return 1;
+            }
+            options.blockSize = bs;
+        }
+        else if (arg[0] != '-') {
+            inputFiles.push_back(arg);
+        }
+    }
 
-        AudioFile<float> result;
-        std::vector<std::vector<float>> bufferasVector = { std::vector<float>(buffer[0],buffer[0] +bufferSize),std::vector<float>(buffer[1],buffer[1]+bufferSize) };
+    if (options.profile) {
+        Profiler::instance().enable();
+    }
+    ProfileReport profileReport{ options };
 
-        result.setAudioBuffer(bufferasVector);
-        result.setSampleRate(sampleRate);
-        result.setBitDepth(16);
+    if (!options.serveSocket.empty()) {
+        if (options.streamMode || options.limiter || options.incremental || options.dryRun) {
+            std::cerr << "--serve renders whole timelines in memory and cannot be combined with --stream, --limiter, --incremental or --dry-run.\n";
+            return 1;
+        }
+        RenderServer server(options);
+        return server.run(options.serveSocket);
+    }
 
-        if (result.save(outputFile)) {
-            std::cout << "Saved to " << outputFile << " ("
-                << bufferasVector[0].size() / sampleRate << " seconds)\n";
+    if (!batchManifest.empty() || inputFiles.size() > 1) {
+        if (options.streamMode || options.limiter || options.incremental || options.dryRun || !options.saveClipList.empty()) {
+            std::cerr << "Batch mode renders whole timelines in memory and cannot be combined with --stream, --limiter, --incremental, --dry-run or --save-clip-list.\n";
+            return 1;
         }
-        else {
-            std::cerr << "Failed to save: " << outputFile << "\n";
+        if (outputGiven) {
+            std::cerr << "-o cannot be used with several input files or --batch; each clip list is written to its own output.\n";
+            return 1;
+        }
+        std::vector<BatchJob> jobs;
+        if (!batchManifest.empty() && !parseBatchManifest(batchManifest, jobs)) {
+            return 1;
+        }
+        // 命令行上的多个列表各自输出到同名的 .wav
+        for (const std::string& input : inputFiles) {
+            jobs.push_back({ input, std::filesystem::path(input).replace_extension(".wav").string() });
+        }
+        if (jobs.empty()) {
+            std::cerr << "No jobs found in " << batchManifest << "\n";
+            return 1;
+        }
+        return renderBatch(jobs, options);
+    }
+    if (inputFiles.empty()) {
+        showHelp(argv[0]);
+        return -1;
+    }
+
+    //try {
+        std::vector<struct AudioClip> clips;
+        try {
+            clips = parseInputFile(inputFiles[0], options.jobs);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        if (clips.empty()) {
+            std::cerr << "No valid clips found.\n";
+            return 1;
+        }
+        if (!options.saveClipList.empty()) {
+            if (!ClipList::saveBinary(options.saveClipList, clips)) {
+                std::cerr << "Failed to save: " << options.saveClipList << "\n";
+                return 1;
+            }
+            std::cout << "Saved " << clips.size() << " clips to " << options.saveClipList << "\n";
+            return 0;
+        }
+        if (options.dryRun) {
+            return reportDryRun(clips, options);
+        }
+        if (options.incremental) {
+            if (options.limiter) {
+                std::cerr << "--limiter cannot be combined with --incremental.\n";
+                return 1;
+            }
+            return renderIncremental(clips, options);
+        }
+        if (options.streamMode || options.limiter) {
+            return renderStreaming(clips, options);
+        }
+        Compositor compositor(options);
+        if (!compositor.renderToFile(clips, options.outputFile)) {
             return 1;
         }
 
@@ -0,0 +1,498 @@
+﻿#include "AudioFile.h"
+#include "Resampler.h"
+#include "MixKernels.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <random>
+
+//wavCompositorExtended 基准测试：生成合成的 wav 素材和片段列表，分别计时各个阶段
+//（读取、解码、重采样、混音、归一化、编码），输出每秒采样数和 MB/s，可选写出 JSON 便于在版本之间比较
+
+struct BenchOptions {
+    std::string corpusDir = "bench_corpus";
+    std::string jsonFile;        // 非空时把结果写成 JSON
+    int hits = 200;              // 短音效个数（0.05~0.5 秒）
+    int stems = 4;               // 长音轨个数
+    double stemSeconds = 30.0;
+    int clips = 4000;            // 片段列表中的事件数
+    double timelineSeconds = 120.0;
+    int sampleRate = 44100;      // 混音的目标采样率
+    int repeat = 3;              // 每个阶段重复次数，取最快的一次
+    uint32_t seed = 1;
+};
+
+struct CorpusFile {
+    std::string path;
+    int sampleRate = 0;
+    int bitDepth = 0;
+    int numChannels = 0;
+    int64_t numSamples = 0;
+    int64_t fileBytes = 0;
+};
+
+struct ClipEvent {
+    size_t file = 0;
+    int64_t startSample = 0;
+    float volume = 0.0f;
+};
+
+struct StageResult {
+    std::string name;
+    double seconds = 0.0;
+    int64_t samples = 0; // 处理的采样数（各声道合计）
+    int64_t bytes = 0;   // 处理的字节数，含义见各阶段的注释
+};
+
+// 生成素材：短音效和长音轨覆盖常见的采样率、位深和声道数，内容是衰减的正弦波加少量噪声。
+// 同时写出 clips.txt，可以直接交给 wavCompositorExtended 做端到端测试
+static bool generateCorpus(const BenchOptions& options, std::vector<CorpusFile>& files, std::vector<ClipEvent>& events)
+{
+    std::error_code error;
+    std::filesystem::create_directories(options.corpusDir, error);
+    if (error)
+    {
+        std::cerr << "Cannot create corpus directory: " << options.corpusDir << "\n";
+        return false;
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const int sampleRates[] = { 22050, 44100, 48000, 96000 };
+    const int bitDepths[] = { 8, 16, 24, 32 };
+    const double pi = 3.14159265358979323846;
+
+    const int total = options.hits + options.stems;
+    for (int i = 0; i < total; ++i)
+    {
+        const bool stem = i >= options.hits;
+        CorpusFile file;
+        file.sampleRate = sampleRates[rng() % 4];
+        file.bitDepth = stem ? 24 : bitDepths[rng() % 4];
+        file.numChannels = stem ? 2 : static_cast<int>(1 + rng() % 2);
+        const double seconds = stem ? options.stemSeconds : 0.05 + unit(rng) * 0.45;
+        file.numSamples = static_cast<int64_t>(seconds * file.sampleRate);
+
+        const double frequency = 60.0 + unit(rng) * 2000.0;
+        const double decay = stem ? 0.0 : 3.0 + unit(rng) * 20.0;
+        AudioFile<float> audio;
+        audio.setSampleRate(static_cast<uint32_t>(file.sampleRate));
+        audio.setBitDepth(file.bitDepth);
+        audio.setAudioBufferSize(file.numChannels, file.numSamples);
+        for (int ch = 0; ch < file.numChannels; ++ch)
+        {
+            const double phase = ch * 0.25;
+            for (int64_t n = 0; n < file.numSamples; ++n)
+            {
+                const double t = static_cast<double>(n) / file.sampleRate;
+                const double envelope = stem ? 0.5 : std::exp(-decay * t);
+                audio.samples[ch][n] = static_cast<float>(envelope * (0.8 * std::sin(2.0 * pi * frequency * t + phase) + 0.1 * (unit(rng) - 0.5)));
+            }
+        }
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "%s_%03d_%dk_%db.wav", stem ? "stem" : "hit", i, file.sampleRate / 1000, file.bitDepth);
+        file.path = (std::filesystem::path(options.corpusDir) / name).string();
+        if (!audio.save(file.path))
+        {
+            std::cerr << "Failed to save: " << file.path << "\n";
+            return false;
+        }
+        file.fileBytes = static_cast<int64_t>(std::filesystem::file_size(file.path, error));
+        files.push_back(file);
+    }
+
+    // 片段列表：大部分是短音效，长音轨各出现一次
+    const std::string listPath = (std::filesystem::path(options.corpusDir) / "clips.txt").string();
+    std::ofstream list(listPath);
+    for (int i = 0; i < options.clips; ++i)
+    {
+        ClipEvent event;
+        const bool stem = options.stems > 0 && i < options.stems;
+        event.file = stem ? static_cast<size_t>(options.hits + i) : (options.hits > 0 ? rng() % options.hits : 0);
+        const double startTime = stem ? 0.0 : unit(rng) * options.timelineSeconds;
+        event.startSample = static_cast<int64_t>(std::llround(startTime * options.sampleRate));
+        event.volume = static_cast<float>(0.2 + unit(rng) * 0.8);
+        list << files[event.file].path << " " << startTime << " " << event.volume << "\n";
+        events.push_back(event);
+    }
+    return static_cast<bool>(list);
+}
+
+// 运行 repeat 次，返回最快一次的秒数；prepare 在每次计时之前执行，不计入时间
+static double timeStage(int repeat, const std::function<void()>& prepare, const std::function<void()>& body)
+{
+    double best = 0.0;
+    for (int r = 0; r < repeat; ++r)
+    {
+        prepare();
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = r == 0 ? seconds : std::min(best, seconds);
+    }
+    return best;
+}
+
+// 重采样阻带检查：略高于目标奈奎斯特频率的正弦波重采样之后应该几乎完全滤掉，剩下的就是混叠回通带的成分。
+// 返回相对输入的衰减（dB），只统计中间 60% 的输出，避开两端起止的瞬态
+static double measureRejection(int sr, int newsr, double toneHz, ResampleQuality quality)
+{
+    const double pi = 3.14159265358979323846;
+    const double amplitude = 0.5;
+    std::vector<float> tone(static_cast<size_t>(sr) * 2);
+    for (size_t i = 0; i < tone.size(); ++i)
+    {
+        tone[i] = static_cast<float>(amplitude * std::sin(2.0 * pi * toneHz * static_cast<double>(i) / sr));
+    }
+    resampleAudio(tone, sr, newsr, quality);
+    const size_t from = tone.size() / 5;
+    const size_t to = tone.size() - from;
+    double energy = 0.0;
+    for (size_t i = from; i < to; ++i)
+    {
+        energy += static_cast<double>(tone[i]) * tone[i];
+    }
+    const double rms = std::sqrt(energy / static_cast<double>(to - from));
+    return -20.0 * std::log10(std::max(rms / (amplitude / std::sqrt(2.0)), 1e-12));
+}
+
+// --check-resampler：在几种常见的降采样组合下，检查 Medium/Best 对 1.02 倍目标奈奎斯特频率的正弦波的衰减
+// 是否达到标称的阻带衰减，达不到时返回非零
+static int checkResampler()
+{
+    struct Case {
+        int sr;
+        int newsr;
+    };
+    const Case cases[] = { { 48000, 44100 }, { 96000, 44100 }, { 44100, 22050 }, { 192000, 48000 } };
+    struct Preset {
+        const char* name;
+        ResampleQuality quality;
+        double minRejection;
+    };
+    const Preset presets[] = { { "medium", ResampleQuality::Medium, 80.0 }, { "best", ResampleQuality::Best, 115.0 } };
+    int failed = 0;
+    for (const Preset& preset : presets)
+    {
+        for (const Case& c : cases)
+        {
+            const double toneHz = 1.02 * c.newsr / 2.0;
+            const double rejection = measureRejection(c.sr, c.newsr, toneHz, preset.quality);
+            const bool ok = rejection >= preset.minRejection;
+            failed += ok ? 0 : 1;
+            std::printf("%-8s %6d -> %6d Hz, tone %8.1f Hz: %6.1f dB (need %.0f) %s\n", preset.name, c.sr, c.newsr, toneHz, rejection,
+                preset.minRejection, ok ? "ok" : "FAIL");
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+static void printResult(const StageResult& result)
+{
+    const double seconds = std::max(result.seconds, 1e-9);
+    std::printf("%-18s %10.3f ms %12.1f Msamples/s %10.1f MB/s\n", result.name.c_str(), result.seconds * 1000.0,
+        result.samples / seconds / 1e6, result.bytes / seconds / 1e6);
+}
+
+static bool writeJson(const std::string& path, const BenchOptions& options, const std::vector<CorpusFile>& files, const std::vector<StageResult>& results)
+{
+    int64_t corpusBytes = 0;
+    for (const CorpusFile& file : files)
+    {
+        corpusBytes += file.fileBytes;
+    }
+    std::ofstream json(path);
+    json << "{\n";
+    json << "  \"version\": 1,\n";
+    json << "  \"config\": { \"hits\": " << options.hits << ", \"stems\": " << options.stems << ", \"stemSeconds\": " << options.stemSeconds
+        << ", \"clips\": " << options.clips << ", \"timelineSeconds\": " << options.timelineSeconds << ", \"sampleRate\": " << options.sampleRate
+        << ", \"repeat\": " << options.repeat << ", \"seed\": " << options.seed << ", \"corpusBytes\": " << corpusBytes << " },\n";
+    json << "  \"stages\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const StageResult& result = results[i];
+        const double seconds = std::max(result.seconds, 1e-9);
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "    { \"name\": \"%s\", \"seconds\": %.6f, \"samples\": %lld, \"bytes\": %lld, \"samplesPerSec\": %.1f, \"mbPerSec\": %.2f }%s\n",
+            result.name.c_str(), result.seconds, static_cast<long long>(result.samples), static_cast<long long>(result.bytes),
+            result.samples / seconds, result.bytes / seconds / 1e6, i + 1 < results.size() ? "," : "");
+        json << line;
+    }
+    json << "  ]\n}\n";
+    return static_cast<bool>(json);
+}
+
+inline static void showHelp(char* argv0)
+{
+    std::cerr << "Usage: " << argv0 << " [--dir <corpus dir> default:bench_corpus] [--json <file>] [--hits <n> default:200] [--stems <n> default:4] [--stem-seconds <s> default:30] [--clips <n> default:4000] [--seconds <timeline seconds> default:120] [-s <sample rate> default:44100] [--repeat <n> default:3] [--seed <n>] [--check-resampler]\n";
+    std::printf("Generates a synthetic corpus and clip list, then times load, decode, resample, mix, normalize and encode separately.\n");
+    std::printf("--check-resampler only measures how well the medium and best resamplers reject a tone just above the target Nyquist frequency, and fails below their rated stopband.\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h") {
+            showHelp(argv[0]);
+            return 0;
+        }
+        if (arg == "--check-resampler") {
+            return checkResampler();
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return -1;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--dir") {
+            options.corpusDir = value;
+        }
+        else if (arg == "--json") {
+            options.jsonFile = value;
+        }
+        else if (arg == "--hits") {
+            options.hits = std::max(0, std::stoi(value));
+        }
+        else if (arg == "--stems") {
+            options.stems = std::max(0, std::stoi(value));
+        }
+        else if (arg == "--stem-seconds") {
+            options.stemSeconds = std::max(0.1, std::stod(value));
+        }
+        else if (arg == "--clips") {
+            options.clips = std::max(0, std::stoi(value));
+        }
+        else if (arg == "--seconds") {
+            options.timelineSeconds = std::max(1.0, std::stod(value));
+        }
+        else if (arg == "-s") {
+            options.sampleRate = std::clamp(std::stoi(value), 1, 384000);
+        }
+        else if (arg == "--repeat") {
+            options.repeat = std::max(1, std::stoi(value));
+        }
+        else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::stoul(value));
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            showHelp(argv[0]);
+            return -1;
+        }
+    }
+    if (options.hits + options.stems == 0) {
+        std::cerr << "The corpus needs at least one file.\n";
+        return 1;
+    }
+
+    std::vector<CorpusFile> files;
+    std::vector<ClipEvent> events;
+    std::cout << "Generating corpus in " << options.corpusDir << "...\n";
+    if (!generateCorpus(options, files, events)) {
+        return 1;
+    }
+
+    std::vector<StageResult> results;
+    int64_t corpusSamples = 0;
+    int64_t corpusBytes = 0;
+    for (const CorpusFile& file : files)
+    {
+        corpusSamples += file.numSamples * file.numChannels;
+        corpusBytes += file.fileBytes;
+    }
+
+    // 读取：AudioFile::load，含文件 IO（字节数为 wav 文件大小）
+    {
+        StageResult result{ "load" };
+        result.seconds = timeStage(options.repeat, [] {}, [&] {
+            for (const CorpusFile& file : files)
+            {
+                AudioFile<float> audio;
+                audio.load(file.path);
+            }
+        });
+        result.samples = corpusSamples;
+        result.bytes = corpusBytes;
+        results.push_back(result);
+    }
+
+    // 解码：文件已经读入内存，只计 loadFromMemory / decodeWaveFile
+    std::vector<std::vector<uint8_t>> fileData(files.size());
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        std::ifstream input(files[i].path, std::ios::binary);
+        fileData[i].assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    std::vector<AudioFile<float>> decoded(files.size());
+    {
+        StageResult result{ "decode" };
+        result.seconds = timeStage(options.repeat, [] {}, [&] {
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                decoded[i].loadFromMemory(fileData[i]);
+            }
+        });
+        result.samples = corpusSamples;
+        result.bytes = corpusBytes;
+        results.push_back(result);
+    }
+    fileData.clear();
+
+    // 重采样到目标采样率（字节数为输入的 float 采样）
+    std::vector<std::vector<std::vector<float>>> resampled;
+    const std::pair<const char*, ResampleQuality> qualities[] = {
+        { "resample-fast", ResampleQuality::Fast },
+        { "resample-medium", ResampleQuality::Medium },
+        { "resample-best", ResampleQuality::Best },
+    };
+    for (const auto& quality : qualities)
+    {
+        StageResult result{ quality.first };
+        int64_t inputSamples = 0;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            if (files[i].sampleRate != options.sampleRate)
+            {
+                inputSamples += files[i].numSamples * files[i].numChannels;
+            }
+        }
+        // 先设计好滤波器表，不计入时间
+        for (const CorpusFile& file : files)
+        {
+            if (quality.second != ResampleQuality::Fast && file.sampleRate != options.sampleRate)
+            {
+                PolyphaseFilter::get(file.sampleRate, options.sampleRate, quality.second);
+            }
+        }
+        std::vector<std::vector<std::vector<float>>> buffers;
+        result.seconds = timeStage(options.repeat, [&] {
+            buffers.assign(files.size(), {});
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                buffers[i] = decoded[i].samples;
+            }
+        }, [&] {
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                for (std::vector<float>& channel : buffers[i])
+                {
+                    resampleAudio(channel, files[i].sampleRate, options.sampleRate, quality.second);
+                }
+            }
+        });
+        result.samples = inputSamples;
+        result.bytes = inputSamples * static_cast<int64_t>(sizeof(float));
+        results.push_back(result);
+        if (quality.second == ResampleQuality::Medium)
+        {
+            resampled = std::move(buffers);
+        }
+    }
+    decoded.clear();
+
+    // 混音：按片段列表把重采样后的音源累加到立体声时间线（采样数、字节数按写入时间线的采样计）
+    int64_t timelineSamples = 0;
+    for (const ClipEvent& event : events)
+    {
+        timelineSamples = std::max(timelineSamples, event.startSample + static_cast<int64_t>(resampled[event.file][0].size()));
+    }
+    std::vector<float> left, right;
+    {
+        StageResult result{ "mix" };
+        int64_t mixedSamples = 0;
+        for (const ClipEvent& event : events)
+        {
+            mixedSamples += static_cast<int64_t>(resampled[event.file][0].size()) * 2;
+        }
+        result.seconds = timeStage(options.repeat, [&] {
+            left.assign(static_cast<size_t>(timelineSamples), 0.0f);
+            right.assign(static_cast<size_t>(timelineSamples), 0.0f);
+        }, [&] {
+            for (const ClipEvent& event : events)
+            {
+                const std::vector<std::vector<float>>& source = resampled[event.file];
+                const int64_t count = static_cast<int64_t>(source[0].size());
+                if (source.size() == 1)
+                {
+                    MixKernel<true>::process(source[0].data(), nullptr, event.volume, left.data() + event.startSample, right.data() + event.startSample, count);
+                }
+                else
+                {
+                    MixKernel<false>::process(source[0].data(), source[1].data(), event.volume, left.data() + event.startSample, right.data() + event.startSample, count);
+                }
+            }
+        });
+        result.samples = mixedSamples;
+        result.bytes = mixedSamples * static_cast<int64_t>(sizeof(float));
+        results.push_back(result);
+    }
+    resampled.clear();
+
+    // 归一化：求峰值并乘增益（字节数为时间线的 float 采样）
+    const std::vector<float> mixedLeft = left, mixedRight = right;
+    {
+        StageResult result{ "normalize" };
+        result.seconds = timeStage(options.repeat, [&] {
+            left = mixedLeft;
+            right = mixedRight;
+        }, [&] {
+            const float peak = peakAbs(left.data(), right.data(), timelineSamples);
+            if (peak > 1.0f)
+            {
+                const float gain = 1.0f / peak;
+                for (int64_t i = 0; i < timelineSamples; ++i)
+                {
+                    left[i] *= gain;
+                    right[i] *= gain;
+                }
+            }
+        });
+        result.samples = timelineSamples * 2;
+        result.bytes = timelineSamples * 2 * static_cast<int64_t>(sizeof(float));
+        results.push_back(result);
+    }
+
+    // 编码：saveToMemory / encodeWaveFile 输出 16 位立体声（字节数为输出的 wav 数据）
+    {
+        StageResult result{ "encode" };
+        AudioFile<float> output;
+        output.setSampleRate(static_cast<uint32_t>(options.sampleRate));
+        output.setBitDepth(16);
+        output.samples = { left, right };
+        std::vector<uint8_t> encoded;
+        result.seconds = timeStage(options.repeat, [&] { encoded.clear(); }, [&] {
+            output.saveToMemory(encoded);
+        });
+        result.samples = timelineSamples * 2;
+        result.bytes = static_cast<int64_t>(encoded.size());
+        results.push_back(result);
+    }
+
+    std::printf("Corpus: %zu files, %.1f MiB, %d clips, timeline %.1f s at %d Hz\n", files.size(), corpusBytes / 1048576.0,
+        options.clips, static_cast<double>(timelineSamples) / options.sampleRate, options.sampleRate);
+    for (const StageResult& result : results)
+    {
+        printResult(result);
+    }
+    if (!options.jsonFile.empty())
+    {
+        if (!writeJson(options.jsonFile, options, files, results))
+        {
+            std::cerr << "Failed to write " << options.jsonFile << "\n";
+            return 1;
+        }
+        std::cout << "Wrote " << options.jsonFile << "\n";
+    }
+    return 0;
+}